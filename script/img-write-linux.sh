@@ -40,4 +40,5 @@ dd if=loader.bin of=$DISK1_NAME bs=512 conv=notrunc seek=1
 # sudo cp -v init.elf $TARGET_PATH/init
 # sudo cp -v shell.elf $TARGET_PATH
 # sudo cp -v loop.elf $TARGET_PATH/loop
+# sudo cp -v bench.elf $TARGET_PATH/bench
 # sudo umount $TARGET_PATH
@@ -40,5 +40,6 @@ hdiutil attach $DISK2_NAME
 # cp -v init.elf $TARGET_PATH/init
 # cp -v shell.elf $TARGET_PATH
 # cp -v loop.elf $TARGET_PATH/loop
+# cp -v bench.elf $TARGET_PATH/bench
 cp -v *.elf $TARGET_PATH
 hdiutil detach $TARGET_PATH -verbose
@@ -37,6 +37,7 @@ dd if=boot.bin of=%DISK1_NAME% bs=512 conv=notrunc count=1
 @REM copy /Y init.elf %TARGET_PATH%:\init
 @REM copy /Y shell.elf %TARGET_PATH%:\shell.elf
 @REM copy /Y loop %TARGET_PATH%:\loop
+@REM copy /Y bench.elf %TARGET_PATH%:\bench
 
 @REM echo select vdisk file="%cd%\%DISK2_NAME%" >a.txt
 @REM echo detach vdisk >>a.txt
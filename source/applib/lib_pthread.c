@@ -0,0 +1,104 @@
+#include "lib_pthread.h"
+#include "lib_syscall.h"
+#include <stdlib.h>
+
+struct _reent;
+
+static void pthread_entry(void * arg) {
+    pthread_info_t * info = (pthread_info_t *)arg;
+    info->ret = info->start(info->arg);
+    _exit(0);
+}
+
+/**
+ * 线程与创建者共用地址空间和打开的文件，栈单独映射
+ * 线程是调用者的子进程，只能由创建它的线程join
+ */
+int pthread_create(pthread_t * thread, const pthread_attr_t * attr, void * (*start)(void *), void * arg) {
+    pthread_info_t * info = (pthread_info_t *)malloc(sizeof(pthread_info_t));
+    if (info == (pthread_info_t *)0) {
+        return -1;
+    }
+
+    void * stack = mmap((void *)0, PTHREAD_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        free(info);
+        return -1;
+    }
+    info->start = start;
+    info->arg = arg;
+    info->ret = (void *)0;
+    info->stack = stack;
+
+    int tid = clone(pthread_entry, (char *)stack + PTHREAD_STACK_SIZE, info);
+    if (tid < 0) {
+        munmap(stack, PTHREAD_STACK_SIZE);
+        free(info);
+        return -1;
+    }
+    info->tid = tid;
+    *thread = info;
+    return 0;
+}
+
+int pthread_join(pthread_t thread, void ** ret) {
+    int status;
+    if (waitpid(thread->tid, &status, 0) < 0) {
+        return -1;
+    }
+
+    if (ret) {
+        *ret = thread->ret;
+    }
+    munmap(thread->stack, PTHREAD_STACK_SIZE);
+    free(thread);
+    return 0;
+}
+
+int pthread_mutex_init(pthread_mutex_t * mutex, const pthread_mutexattr_t * attr) {
+    mutex->locked = 0;
+    mutex->owner = 0;
+    mutex->count = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t * mutex) {
+    return 0;
+}
+
+/**
+ * 获取不到锁时让出处理器，等下次被调度再试
+ */
+int pthread_mutex_lock(pthread_mutex_t * mutex) {
+    while (__sync_lock_test_and_set(&mutex->locked, 1)) {
+        yield();
+    }
+    return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t * mutex) {
+    __sync_lock_release(&mutex->locked);
+    return 0;
+}
+
+// newlib的malloc通过这两个函数加锁，同一线程会嵌套调用
+static pthread_mutex_t malloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void __malloc_lock(struct _reent * reent) {
+    int self = get_pid();
+    if (malloc_mutex.locked && (malloc_mutex.owner == self)) {
+        malloc_mutex.count++;
+        return;
+    }
+
+    pthread_mutex_lock(&malloc_mutex);
+    malloc_mutex.owner = self;
+    malloc_mutex.count = 1;
+}
+
+void __malloc_unlock(struct _reent * reent) {
+    if (--malloc_mutex.count == 0) {
+        malloc_mutex.owner = 0;
+        pthread_mutex_unlock(&malloc_mutex);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef LIB_PTHREAD_H
+#define LIB_PTHREAD_H
+
+#define PTHREAD_STACK_SIZE          (64 * 1024)
+
+typedef struct _pthread_info_t {
+    int tid;
+    void * (*start)(void *);
+    void * arg;
+    void * ret;
+    void * stack;
+}pthread_info_t;
+
+typedef pthread_info_t * pthread_t;
+
+// 暂不支持属性，只保留参数
+typedef int pthread_attr_t;
+typedef int pthread_mutexattr_t;
+
+typedef struct _pthread_mutex_t {
+    volatile int locked;
+    int owner;                      // 递归加锁时记录持有者
+    int count;
+}pthread_mutex_t;
+
+#define PTHREAD_MUTEX_INITIALIZER   {0, 0, 0}
+
+int pthread_create(pthread_t * thread, const pthread_attr_t * attr, void * (*start)(void *), void * arg);
+int pthread_join(pthread_t thread, void ** ret);
+
+int pthread_mutex_init(pthread_mutex_t * mutex, const pthread_mutexattr_t * attr);
+int pthread_mutex_destroy(pthread_mutex_t * mutex);
+int pthread_mutex_lock(pthread_mutex_t * mutex);
+int pthread_mutex_unlock(pthread_mutex_t * mutex);
+
+#endif
@@ -1,10 +1,46 @@
 #include "lib_syscall.h"
+#include "comm/cpu_instr.h"
 #include "core/syscall.h"
 #include "os_cfg.h"
 #include <stdlib.h>
 
 
+static int sysenter_state;          // 0未检测，1使用sysenter，-1使用调用门
+
+/**
+ * 通过sysenter进入内核，参数放在寄存器中，不经过调用门的权限检查和参数复制
+ * 返回时ecx、edx被内核用于恢复用户栈和返回地址
+ * sysexit不恢复标志寄存器，进入前由用户自己保存，返回后恢复DF、AC及算术标志
+ */
+static inline int sys_call_fast(syscall_args_t * args) {
+    int ret;
+    int arg1 = args->args1, arg2 = args->args2;
+    __asm__ __volatile__ (
+        "pushfl\n\t"
+        "push %%ebp\n\t"
+        "mov %%esp, %%ebp\n\t"
+        "lea 1f, %%edi\n\t"
+        "sysenter\n"
+        "1:\n\t"
+        "pop %%ebp\n\t"
+        "popfl"
+        :"=a"(ret), "+c"(arg1), "+d"(arg2):
+        "a"(args->id),
+        "b"(args->args0),
+        "S"(args->args3)
+        :"edi", "cc", "memory"
+    );
+    return ret;
+}
+
 static inline int sys_call(syscall_args_t * args) {
+    if (sysenter_state == 0) {
+        sysenter_state = cpu_has_sysenter() ? 1 : -1;
+    }
+    if (sysenter_state > 0) {
+        return sys_call_fast(args);
+    }
+
     uint32_t addr[] = {0, SELECTOR_SYSCALL | 0};
     int ret;
     __asm__ __volatile__ (
@@ -37,11 +73,11 @@ void msleep(int ms) {
     sys_call(&args);
 }
 
+/**
+ * 直接读取内核映射的进程页，不进入内核
+ */
 int get_pid() {
-    syscall_args_t args;
-    args.id = SYS_getpid;
-
-    return sys_call(&args);
+    return ((vdso_proc_t *)VDSO_PROC_ADDR)->pid;
 }
 
 void print_msg(const char * fmt, int arg) {
@@ -60,6 +96,84 @@ int fork(void) {
     return sys_call(&args);
 }
 
+/**
+ * 创建线程，在stack_top指向的栈上运行entry(arg)，entry不能返回
+ */
+int clone(void (*entry)(void *), void * stack_top, void * arg) {
+    uint32_t * sp = (uint32_t *)stack_top;
+    *--sp = (uint32_t)arg;
+    *--sp = 0;
+
+    syscall_args_t args;
+    args.id = SYS_clone;
+    args.args0 = (int)entry;
+    args.args1 = (int)sp;
+
+    return sys_call(&args);
+}
+
+/**
+ * 登记批量提交用的环，ring为空时取消登记
+ */
+int ring_setup(sysring_t * ring) {
+    syscall_args_t args;
+    args.id = SYS_ring_setup;
+    args.args0 = (int)ring;
+
+    return sys_call(&args);
+}
+
+/**
+ * 进入内核一次处理最多to_submit个已提交的调用，返回处理的个数
+ */
+int ring_enter(int to_submit) {
+    syscall_args_t args;
+    args.id = SYS_ring_enter;
+    args.args0 = to_submit;
+
+    return sys_call(&args);
+}
+
+int sysring_push(sysring_t * ring, int id, int arg0, int arg1, int arg2, unsigned int user_data) {
+    if (ring->sq_tail - ring->sq_head >= SYSRING_ENTRIES) {
+        return -1;
+    }
+
+    sysring_sqe_t * sqe = ring->sq + (ring->sq_tail & (SYSRING_ENTRIES - 1));
+    sqe->id = id;
+    sqe->args[0] = arg0;
+    sqe->args[1] = arg1;
+    sqe->args[2] = arg2;
+    sqe->args[3] = 0;
+    sqe->user_data = user_data;
+    ring->sq_tail++;
+    return 0;
+}
+
+int sysring_pop(sysring_t * ring, sysring_cqe_t * cqe) {
+    if (ring->cq_head == ring->cq_tail) {
+        return -1;
+    }
+
+    *cqe = ring->cq[ring->cq_head & (SYSRING_ENTRIES - 1)];
+    ring->cq_head++;
+    return 0;
+}
+
+/**
+ * 由程序文件直接创建子进程，fd_map为空时继承所有打开的文件，
+ * 否则fd_map[0~2]依次作为子进程的标准输入、输出和错误输出，-1表示不打开
+ */
+int spawn(const char * name, char * const * argv, const int * fd_map) {
+    syscall_args_t args;
+    args.id = SYS_spawn;
+    args.args0 = (int)name;
+    args.args1 = (int)argv;
+    args.args2 = (int)fd_map;
+
+    return sys_call(&args);
+}
+
 int execve(const char * name, char * const * argv, char * const * env) {
     syscall_args_t args;
     args.id = SYS_execve;
@@ -149,6 +263,173 @@ void * sbrk(ptrdiff_t inc) {
     return (void *)sys_call(&args);
 }
 
+void * mmap(void * addr, int length, int prot, int flags, int fd, int offset) {
+    mmap_args_t mmap_args;
+    mmap_args.addr = addr;
+    mmap_args.length = length;
+    mmap_args.prot = prot;
+    mmap_args.flags = flags;
+    mmap_args.fd = fd;
+    mmap_args.offset = offset;
+
+    syscall_args_t args;
+    args.id = SYS_mmap;
+    args.args0 = (int)&mmap_args;
+
+    return (void *)sys_call(&args);
+}
+
+int munmap(void * addr, int length) {
+    syscall_args_t args;
+    args.id = SYS_munmap;
+    args.args0 = (int)addr;
+    args.args1 = length;
+
+    return sys_call(&args);
+}
+
+int shmget(const char * name, int size) {
+    syscall_args_t args;
+    args.id = SYS_shmget;
+    args.args0 = (int)name;
+    args.args1 = size;
+
+    return sys_call(&args);
+}
+
+void * shmat(int id, void * addr) {
+    syscall_args_t args;
+    args.id = SYS_shmat;
+    args.args0 = id;
+    args.args1 = (int)addr;
+
+    return (void *)sys_call(&args);
+}
+
+int shmdt(void * addr) {
+    syscall_args_t args;
+    args.id = SYS_shmdt;
+    args.args0 = (int)addr;
+
+    return sys_call(&args);
+}
+
+int shmrm(int id) {
+    syscall_args_t args;
+    args.id = SYS_shmrm;
+    args.args0 = id;
+
+    return sys_call(&args);
+}
+
+int setpriority(int which, int who, int prio) {
+    syscall_args_t args;
+    args.id = SYS_setpriority;
+    args.args0 = which;
+    args.args1 = who;
+    args.args2 = prio;
+
+    return sys_call(&args);
+}
+
+int getpriority(int which, int who) {
+    syscall_args_t args;
+    args.id = SYS_getpriority;
+    args.args0 = which;
+    args.args1 = who;
+
+    return sys_call(&args);
+}
+
+/**
+ * 从时间页读取时间，加上上次更新以来经过的TSC周期
+ * 距上次更新过久，换算可能溢出时返回-1，改用系统调用
+ */
+static int vdso_clock_gettime(clockid_t clk_id, time_spec_t * ts) {
+    vdso_time_t * vdso = (vdso_time_t *)VDSO_TIME_ADDR;
+    unsigned int seq, sec, nsec, tsc_lo, tsc_hi, mult, epoch;
+
+    do {
+        seq = vdso->seq;
+        __asm__ __volatile__("":::"memory");
+        sec = vdso->mono_sec;
+        nsec = vdso->mono_nsec;
+        tsc_lo = vdso->tsc_lo;
+        tsc_hi = vdso->tsc_hi;
+        mult = vdso->tsc_mult;
+        epoch = vdso->boot_epoch;
+        __asm__ __volatile__("":::"memory");
+    } while ((seq & 1) || (seq != vdso->seq));
+
+    if (mult) {
+        uint64_t delta = rdtsc() - (((uint64_t)tsc_hi << 32) | tsc_lo);
+        if (delta >> 32) {
+            return -1;
+        }
+        nsec += (unsigned int)(((uint64_t)(unsigned int)delta * mult) >> VDSO_TSC_SHIFT);
+        while (nsec >= 1000000000) {
+            nsec -= 1000000000;
+            sec++;
+        }
+    }
+
+    ts->sec = (clk_id == CLOCK_REALTIME) ? sec + epoch : sec;
+    ts->nsec = nsec;
+    return 0;
+}
+
+/**
+ * 启动以来的毫秒数，直接读取时间页
+ */
+unsigned int ticks_ms(void) {
+    return ((vdso_time_t *)VDSO_TIME_ADDR)->ticks_ms;
+}
+
+int clock_gettime(clockid_t clk_id, struct timespec * tp) {
+    time_spec_t ts;
+
+    if (((clk_id == CLOCK_MONOTONIC) || (clk_id == CLOCK_REALTIME)) && (vdso_clock_gettime(clk_id, &ts) == 0)) {
+        tp->tv_sec = ts.sec;
+        tp->tv_nsec = ts.nsec;
+        return 0;
+    }
+
+    syscall_args_t args;
+    args.id = SYS_clock_gettime;
+    args.args0 = (int)clk_id;
+    args.args1 = (int)&ts;
+
+    int err = sys_call(&args);
+    if (err < 0) {
+        return err;
+    }
+    tp->tv_sec = ts.sec;
+    tp->tv_nsec = ts.nsec;
+    return 0;
+}
+
+int nanosleep(const struct timespec * req, struct timespec * rem) {
+    if ((req->tv_sec < 0) || (req->tv_nsec < 0)) {
+        return -1;
+    }
+    time_spec_t ts;
+    ts.sec = req->tv_sec;
+    ts.nsec = req->tv_nsec;
+
+    syscall_args_t args;
+    args.id = SYS_nanosleep;
+    args.args0 = (int)&ts;
+
+    int err = sys_call(&args);
+
+    // 睡眠不会被打断，没有剩余时间
+    if (rem) {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return err;
+}
+
 int dup(int file) {
     syscall_args_t args;
     args.id = SYS_dup;
@@ -174,6 +455,16 @@ int wait(int * status) {
     return sys_call(&args);
 }
 
+int waitpid(int pid, int * status, int options) {
+    syscall_args_t args;
+    args.id = SYS_waitpid;
+    args.args0 = pid;
+    args.args1 = (int)status;
+    args.args2 = options;
+
+    return sys_call(&args);
+}
+
 DIR * opendir(const char * path) {
     DIR * dir = (DIR *)malloc(sizeof(DIR));
     if (dir == (DIR *)0) {
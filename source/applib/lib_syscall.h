@@ -3,6 +3,7 @@
 
 #include "sys/_intsup.h"
 #include <sys/stat.h>
+#include <time.h>
 
 typedef struct _syscall_args_t {
     int id;
@@ -12,6 +13,90 @@ typedef struct _syscall_args_t {
     int args3;
 }syscall_args_t;
 
+#define PROT_NONE           0
+#define PROT_READ           (1 << 0)
+#define PROT_WRITE          (1 << 1)
+#define PROT_EXEC           (1 << 2)
+
+#define MAP_SHARED          (1 << 0)
+#define MAP_PRIVATE         (1 << 1)
+#define MAP_ANONYMOUS       (1 << 5)
+#define MAP_FAILED          ((void *)-1)
+
+// 优先级0最高，可用0~7，进程默认为2
+#define PRIO_PROCESS        0
+
+// mmap的参数超过系统调用可传递的个数，打包后传入
+typedef struct _mmap_args_t {
+    void * addr;
+    int length;
+    int prot;
+    int flags;
+    int fd;
+    int offset;
+}mmap_args_t;
+
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME      1
+#endif
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC     4
+#endif
+
+// 内核中的时间格式，与newlib的struct timespec相互转换
+typedef struct _time_spec_t {
+    unsigned int sec;
+    unsigned int nsec;
+}time_spec_t;
+
+// 批量提交系统调用的环，位于用户内存中，由ring_setup登记给内核
+// 用户写入sq并推进sq_tail，内核处理后推进sq_head，结果按顺序写入cq
+#define SYSRING_ENTRIES     64
+
+typedef struct _sysring_sqe_t {
+    int id;
+    int args[4];
+    unsigned int user_data;
+}sysring_sqe_t;
+
+typedef struct _sysring_cqe_t {
+    int ret;
+    unsigned int user_data;
+}sysring_cqe_t;
+
+typedef struct _sysring_t {
+    volatile unsigned int sq_head, sq_tail;
+    volatile unsigned int cq_head, cq_tail;
+    sysring_sqe_t sq[SYSRING_ENTRIES];
+    sysring_cqe_t cq[SYSRING_ENTRIES];
+}sysring_t;
+
+// 内核映射到每个进程的只读页，与内核中的MEM_VDSO_TIME、MEM_VDSO_PROC一致
+#define VDSO_TIME_ADDR      0xE0000000
+#define VDSO_PROC_ADDR      0xE0001000
+#define VDSO_TSC_SHIFT      24
+
+// 由内核定期更新，seq为奇数时正在更新，读取前后seq不同需重读
+typedef struct _vdso_time_t {
+    volatile unsigned int seq;
+    volatile unsigned int ticks_ms;         // 启动以来的毫秒数
+    volatile unsigned int boot_epoch;       // 启动时的实时时间
+    volatile unsigned int mono_sec;         // 更新时的单调时间
+    volatile unsigned int mono_nsec;
+    volatile unsigned int tsc_lo, tsc_hi;   // 更新时的TSC
+    volatile unsigned int tsc_mult;         // 每个TSC周期的纳秒数左移VDSO_TSC_SHIFT位，为0时没有TSC
+}vdso_time_t;
+
+// 内核在创建地址空间及execve、vfork时写入，线程读到的是所属进程的pid
+typedef struct _vdso_proc_t {
+    volatile int pid;
+}vdso_proc_t;
+
+// 与内核中的WAIT_NOHANG一致
+#ifndef WNOHANG
+#define WNOHANG             1
+#endif
+
 struct dirent {
     int index;
     int type;
@@ -28,6 +113,9 @@ void msleep(int ms);
 int get_pid();
 void print_msg(const char * fmt, int arg);
 int fork(void);
+int vfork(void);
+int clone(void (*entry)(void *), void * stack_top, void * arg);
+int spawn(const char * name, char * const * argv, const int * fd_map);
 int execve(const char * name, char * const * argv, char * const * env);
 int yield(void);
 
@@ -41,10 +129,30 @@ int unlink(const char * path_name);
 int isatty(int file);
 int fstat(int file, struct stat * stat);
 void * sbrk(ptrdiff_t inc);
+void * mmap(void * addr, int length, int prot, int flags, int fd, int offset);
+int munmap(void * addr, int length);
+
+int shmget(const char * name, int size);
+void * shmat(int id, void * addr);
+int shmdt(void * addr);
+int shmrm(int id);
+
+int setpriority(int which, int who, int prio);
+int getpriority(int which, int who);
+
+int clock_gettime(clockid_t clk_id, struct timespec * tp);
+unsigned int ticks_ms(void);
+int nanosleep(const struct timespec * req, struct timespec * rem);
+
+int ring_setup(sysring_t * ring);
+int ring_enter(int to_submit);
+int sysring_push(sysring_t * ring, int id, int arg0, int arg1, int arg2, unsigned int user_data);
+int sysring_pop(sysring_t * ring, sysring_cqe_t * cqe);
 
 int dup(int file);
 void _exit(int status);
 int wait(int * status);
+int waitpid(int pid, int * status, int options);
 
 DIR * opendir(const char * path);
 struct dirent * readdir(DIR * dir);
@@ -0,0 +1,135 @@
+/**
+ * 位图分配的主机端性能测试，不在本系统中运行
+ *
+ * 在127MB物理内存对应的页位图上，分别按25%、50%、90%的占用率随机置位，
+ * 比较逐位扫描、每次从头开始的旧算法与按字扫描、从上次位置继续的新算法
+ *
+ * 在源码根目录(source)下编译运行:
+ * gcc -O2 -Ikernel/include -I. bench/host/bitmap.c -o bitmap_bench && ./bitmap_bench
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// 使用主机的定长类型，保证位图的字为32位
+#define _UINT8_T_DECLRED
+#define _UINT16_T_DECLRED
+#define _UINT32_T_DECLRED
+#define _UINT64_T_DECLRED
+
+#include "../../kernel/tools/bitmap.c"
+
+#define FRAME_COUNT         (127 * 1024 * 1024 / 4096)
+#define ALLOC_COUNT         1000        // 每轮分配的次数
+#define ROUND_COUNT         20
+
+static uint32_t bits[FRAME_COUNT / BITMAP_WORD_BITS + 1];
+static int allocated[ALLOC_COUNT];
+static uint32_t rand_seed = 1;
+
+void kernel_memset(void * dest, uint8_t v, int size) {
+    memset(dest, v, size);
+}
+
+static uint32_t rand_next(void) {
+    rand_seed = rand_seed * 1103515245 + 12345;
+    return rand_seed >> 8;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * 原来的实现：逐位检查，每次都从第0位开始
+ */
+static int old_alloc_nbits(bitmap_t * bitmap, int bit, int count) {
+    int search_idx = 0;
+    int ok_index = -1;
+
+    while (search_idx < bitmap->bit_count) {
+        if (bitmap_is_set(bitmap, search_idx) != bit) {
+            search_idx++;
+            continue;
+        }
+        ok_index = search_idx;
+        int i = 1;
+        for ( ; (i < count) && (search_idx < bitmap->bit_count); i++) {
+            if (bitmap_is_set(bitmap, search_idx++) != bit) {
+                ok_index = -1;
+                break;
+            }
+        }
+        if (i >= count) {
+            for (i = 0; i < count; i++) {
+                bitmap_set_bit(bitmap, ok_index + i, 1, !bit);
+            }
+            return ok_index;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 按给定的占用率随机置位
+ */
+static void bitmap_fill(bitmap_t * bitmap, int percent) {
+    bitmap_init(bitmap, (uint8_t *)bits, FRAME_COUNT, 0);
+    rand_seed = 1;
+    for (int used = 0; used < FRAME_COUNT * percent / 100; ) {
+        int index = rand_next() % FRAME_COUNT;
+        if (!bitmap_is_set(bitmap, index)) {
+            bitmap_set_bit(bitmap, index, 1, 1);
+            used++;
+        }
+    }
+}
+
+/**
+ * 反复分配ALLOC_COUNT次count页再全部释放，返回每次分配的平均纳秒数
+ * 找不到空闲位时本轮结束，失败的那次扫描也计入
+ */
+static uint64_t run(int percent, int count, int (*alloc)(bitmap_t *, int, int)) {
+    bitmap_t bitmap;
+    bitmap_fill(&bitmap, percent);
+
+    uint64_t total = 0;
+    int n = 0;
+    for (int round = 0; round < ROUND_COUNT; round++) {
+        uint64_t start = now_ns();
+        int i;
+        for (i = 0; i < ALLOC_COUNT; i++) {
+            allocated[i] = alloc(&bitmap, 0, count);
+            if (allocated[i] < 0) {
+                break;
+            }
+        }
+        total += now_ns() - start;
+        n += (i < ALLOC_COUNT) ? i + 1 : i;
+
+        while (i-- > 0) {
+            bitmap_set_bit(&bitmap, allocated[i], count, 0);
+        }
+    }
+    return total / n;
+}
+
+int main(void) {
+    static const int percents[] = {25, 50, 90};
+    static const int counts[] = {1, 8};
+
+    printf("%d frames, %d allocs x %d rounds\n", FRAME_COUNT, ALLOC_COUNT, ROUND_COUNT);
+    printf("%-6s %-6s %12s %12s\n", "used", "pages", "old ns", "new ns");
+    for (int i = 0; i < sizeof(percents) / sizeof(percents[0]); i++) {
+        for (int j = 0; j < sizeof(counts) / sizeof(counts[0]); j++) {
+            uint64_t old_ns = run(percents[i], counts[j], old_alloc_nbits);
+            uint64_t new_ns = run(percents[i], counts[j], bitmap_alloc_nbits);
+            printf("%-5d%% %-6d %12llu %12llu\n", percents[i], counts[j],
+                    (unsigned long long)old_ns, (unsigned long long)new_ns);
+        }
+    }
+    return 0;
+}
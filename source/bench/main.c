@@ -0,0 +1,177 @@
+/**
+ * 性能测试程序
+ *
+ * bench switch [-n count]: 父子进程轮流调用yield，统计每秒的任务切换次数
+ * bench syscall [-n count]: 分别经调用门和sysenter执行getpid，统计单次调用的耗时
+ */
+#include "getopt.h"
+#include "bench/main.h"
+#include "lib_syscall.h"
+#include "comm/cpu_instr.h"
+#include "core/syscall.h"
+#include "os_cfg.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * 读取单调时钟，以毫秒为单位返回
+ */
+static int now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int)ts.tv_sec * 1000 + (int)(ts.tv_nsec / 1000000);
+}
+
+/**
+ * 父子进程各调用count次yield，两者交替运行，每次yield都引起一次切换
+ */
+static int bench_switch(int count) {
+    int start = now_ms();
+
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, ESC_COLOR_ERROR"fork failed\n"ESC_COLOR_DEFAULT);
+        return -1;
+    } else if (pid == 0) {
+        for (int i = 0; i < count; i++) {
+            yield();
+        }
+        exit(0);
+    }
+
+    for (int i = 0; i < count; i++) {
+        yield();
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    int ms = now_ms() - start;
+    if (ms <= 0) {
+        ms = 1;
+    }
+
+    int switches = count * 2;
+    printf("switch: %d switches in %d ms, %d switches/s\n",
+            switches, ms, switches / ms * 1000 + switches % ms * 1000 / ms);
+    return 0;
+}
+
+/**
+ * 经调用门执行一次getpid，不走vDSO和lib_syscall中的选择逻辑
+ */
+static int getpid_lcall(void) {
+    uint32_t addr[] = {0, SELECTOR_SYSCALL | 0};
+    int ret;
+    __asm__ __volatile__ (
+        "push $0\n\t"
+        "push $0\n\t"
+        "push $0\n\t"
+        "push $0\n\t"
+        "push %[id]\n\t"
+        "lcalll *(%[a])"
+        :"=a"(ret):
+        [id]"r"(SYS_getpid),
+        [a]"r"(addr)
+        :"memory"
+    );
+    return ret;
+}
+
+/**
+ * 经sysenter执行一次getpid，与lib_syscall中的快速调用相同
+ */
+static int getpid_sysenter(void) {
+    int ret, arg1 = 0, arg2 = 0;
+    __asm__ __volatile__ (
+        "pushfl\n\t"
+        "push %%ebp\n\t"
+        "mov %%esp, %%ebp\n\t"
+        "lea 1f, %%edi\n\t"
+        "sysenter\n"
+        "1:\n\t"
+        "pop %%ebp\n\t"
+        "popfl"
+        :"=a"(ret), "+c"(arg1), "+d"(arg2):
+        "a"(SYS_getpid),
+        "b"(0),
+        "S"(0)
+        :"edi", "cc", "memory"
+    );
+    return ret;
+}
+
+/**
+ * 执行count次调用，打印总耗时和每次调用的平均纳秒数
+ */
+static void bench_call(const char * name, int (*call)(void), int count) {
+    int start = now_ms();
+    for (int i = 0; i < count; i++) {
+        call();
+    }
+
+    int ms = now_ms() - start;
+    printf("%s: %d calls in %d ms, %d ns/call\n",
+            name, count, ms, ms * 1000 / count * 1000 + ms * 1000 % count * 1000 / count);
+}
+
+static int bench_syscall(int count) {
+    bench_call("lcall", getpid_lcall, count);
+    if (cpu_has_sysenter()) {
+        bench_call("sysenter", getpid_sysenter, count);
+    } else {
+        puts("sysenter: not supported");
+    }
+    return 0;
+}
+
+static void show_usage(void) {
+    puts("Usage: bench switch [-n count]");
+    puts("       bench syscall [-n count]");
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        show_usage();
+        return -1;
+    }
+
+    // 跳过程序名，从测试名之后开始解析选项
+    const char * test = argv[1];
+    int count = 10000;
+    int ch;
+    while ((ch = getopt(argc - 1, argv + 1, "n:h")) != -1) {
+        switch (ch) {
+            case 'h':
+                show_usage();
+                optind = 1;
+                return 0;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case '?':
+                if (optarg) {
+                    fprintf(stderr, ESC_COLOR_ERROR"Unknown option: -%s\n"ESC_COLOR_DEFAULT, optarg);
+                }
+                optind = 1;
+                return -1;
+        }
+    }
+    optind = 1;
+
+    if (count <= 0) {
+        fprintf(stderr, ESC_COLOR_ERROR"invalid count: %d\n"ESC_COLOR_DEFAULT, count);
+        return -1;
+    }
+
+    if (strcmp(test, "switch") == 0) {
+        return bench_switch(count);
+    } else if (strcmp(test, "syscall") == 0) {
+        return bench_syscall(count);
+    }
+
+    fprintf(stderr, ESC_COLOR_ERROR"Unknown test: %s\n"ESC_COLOR_DEFAULT, test);
+    show_usage();
+    return -1;
+}
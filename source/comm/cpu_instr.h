@@ -134,6 +134,11 @@ static inline void sti(void) {
     __asm__ __volatile__("sti");
 }
 
+// 刷新单个页的TLB项
+static inline void invlpg(uint32_t vaddr) {
+    __asm__ __volatile__("invlpg (%[v])"::[v]"r"(vaddr):"memory");
+}
+
 static inline void write_tr(uint16_t tss_sel) {
     __asm__ __volatile__ ("ltr %%ax"::"a"(tss_sel));
 }
@@ -148,4 +153,52 @@ static inline void write_eflags(uint32_t eflags) {
     __asm__ __volatile__ ("push %%eax\n\tpopf"::"a"(eflags));
 }
 
+static inline void cpuid(uint32_t leaf, uint32_t * eax, uint32_t * ebx, uint32_t * ecx, uint32_t * edx) {
+    __asm__ __volatile__ ("cpuid":"=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx):"a"(leaf), "c"(0));
+}
+
+// 读时间戳计数器
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc":"=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// 清除CR0.TS，之后使用FPU不再触发异常
+static inline void clts(void) {
+    __asm__ __volatile__("clts");
+}
+
+static inline void fninit(void) {
+    __asm__ __volatile__("fninit");
+}
+
+// 保存/恢复512字节的FPU及SSE状态，地址需16字节对齐
+static inline void fxsave(void * state) {
+    __asm__ __volatile__("fxsave (%[s])"::[s]"r"(state):"memory");
+}
+
+static inline void fxrstor(void * state) {
+    __asm__ __volatile__("fxrstor (%[s])"::[s]"r"(state):"memory");
+}
+
+static inline void write_msr(uint32_t msr, uint32_t data) {
+    __asm__ __volatile__("wrmsr"::"c"(msr), "a"(data), "d"(0));
+}
+
+/**
+ * 是否支持SYSENTER/SYSEXIT，内核与应用程序用同一方法判断
+ * 早期的Pentium Pro(family 6, model<3, stepping<3)虽然报告了SEP，但并不支持
+ */
+static inline int cpu_has_sysenter(void) {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ __volatile__ ("cpuid":"=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx):"a"(1), "c"(0));
+    if ((edx & (1 << 11)) == 0) {
+        return 0;
+    }
+
+    uint32_t family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    return !((family == 6) && (model < 3) && (stepping < 3));
+}
+
 #endif
\ No newline at end of file
@@ -1,50 +1,183 @@
 #include "core/memory.h"
+#include "applib/lib_syscall.h"
 #include "comm/boot_info.h"
 #include "comm/types.h"
+#include "core/slab.h"
 #include "core/task.h"
+#include "core/vma.h"
+#include "cpu/irq.h"
 #include "cpu/mmu.h"
 #include "dev/console.h"
-#include "ipc/mutex.h"
-#include "tools/bitmap.h"
+#include "fs/fs.h"
+#include "ipc/shm.h"
+#include "sys/_default_fcntl.h"
+#include "tools/list.h"
 #include "tools/log.h"
 #include "tools/klib.h"
 
 
 static addr_alloc_t paddr_aloc;
 static pde_t kernel_page_dir[PDE_CNT] __attribute__((aligned(MEM_PAGE_SIZE)));
+static list_t zero_page_list;           // 已清零的空闲页，由空闲进程补充
+static int zero_page_count;
+static uint32_t vdso_time_page;         // 所有进程共享的时间页，内核持有一个引用不会被释放
 
-static void addr_alloc_init(addr_alloc_t * addr_alloc, uint8_t * bits, uint32_t start, uint32_t size, uint32_t page_size) {
-    mutex_init(&addr_alloc->mutex);
-    addr_alloc->start = start;
-    addr_alloc->size = size;
-    addr_alloc->page_size = page_size;
-    bitmap_init(&addr_alloc->bitmap, bits, size / page_size, 0);
+static inline page_t * addr_to_page(addr_alloc_t * alloc, uint32_t paddr) {
+    return alloc->pages + (paddr - alloc->start) / MEM_PAGE_SIZE;
+}
+
+static inline page_t * page_ref(uint32_t paddr) {
+    return addr_to_page(&paddr_aloc, paddr);
+}
+
+static void page_ref_inc(uint32_t paddr) {
+    irq_state_t state = irq_enter_protection();
+    page_ref(paddr)->ref++;
+    irq_leave_protection(state);
+}
+
+static int page_ref_count(uint32_t paddr) {
+    irq_state_t state = irq_enter_protection();
+    int ref = page_ref(paddr)->ref;
+    irq_leave_protection(state);
+    return ref;
+}
+
+static int page_order(int page_count) {
+    int order = 0;
+    while ((1 << order) < page_count) {
+        order++;
+    }
+    return order;
+}
+
+static void buddy_push(addr_alloc_t * alloc, int idx, int order) {
+    page_t * page = alloc->pages + idx;
+    page->order = order;
+    page->flags |= PAGE_FREE;
+    list_insert_first(&alloc->free_list[order], &page->node);
+}
+
+// 物理页按伙伴系统管理，块的大小为2^order页
+static void addr_alloc_init(addr_alloc_t * alloc, uint32_t start, uint32_t size) {
+    alloc->start = start;
+    alloc->size = size;
+    alloc->page_count = size / MEM_PAGE_SIZE;
+    for (int i = 0; i <= MEM_BUDDY_ORDER_MAX; i++) {
+        list_init(&alloc->free_list[i]);
+    }
+
+    // 每页的描述信息放在这块内存的开头，这部分页不参与分配
+    alloc->pages = (page_t *)start;
+    int reserved = up2(alloc->page_count * sizeof(page_t), MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    kernel_memset(alloc->pages, 0, reserved * MEM_PAGE_SIZE);
+    for (int i = 0; i < reserved; i++) {
+        alloc->pages[i].ref = 1;
+    }
+
+    int idx = reserved;
+    while (idx < alloc->page_count) {
+        int order = MEM_BUDDY_ORDER_MAX;
+        while ((order > 0) && ((idx & ((1 << order) - 1)) || (idx + (1 << order) > alloc->page_count))) {
+            order--;
+        }
+        buddy_push(alloc, idx, order);
+        idx += 1 << order;
+    }
 }
 
 static uint32_t addr_alloc_page(addr_alloc_t * alloc, int page_count) {
-    mutex_lock(&alloc->mutex);
+    int order = page_order(page_count);
+    if (order > MEM_BUDDY_ORDER_MAX) {
+        return 0;
+    }
+
+    irq_state_t state = irq_enter_protection();
+
+    int curr = order;
+    while ((curr <= MEM_BUDDY_ORDER_MAX) && list_is_empty(&alloc->free_list[curr])) {
+        curr++;
+    }
+    if (curr > MEM_BUDDY_ORDER_MAX) {
+        irq_leave_protection(state);
+        return 0;
+    }
 
-    uint32_t addr = 0;
-    int page_idx = bitmap_alloc_nbits(&alloc->bitmap, 0, page_count);
-    if (page_idx >= 0) {
-        addr = alloc->start + page_idx * alloc->page_size;
+    list_node_t * node = list_remove_first(&alloc->free_list[curr]);
+    page_t * page = field_2_parent(node, page_t, node);
+    int idx = page - alloc->pages;
+
+    // 把多余的后半部分拆分出来，放回低一级的空闲链表
+    while (curr > order) {
+        curr--;
+        buddy_push(alloc, idx + (1 << curr), curr);
     }
+    page->flags &= ~PAGE_FREE;
+    page->order = order;
+    page->ref = 1;
 
-    mutex_unlock(&alloc->mutex);
+    irq_leave_protection(state);
 
-    return addr;
+    return alloc->start + idx * MEM_PAGE_SIZE;
 }
 
 static void addr_free_page(addr_alloc_t * alloc, uint32_t addr, int page_count) {
-    mutex_lock(&alloc->mutex);
+    irq_state_t state = irq_enter_protection();
+
+    int idx = (addr - alloc->start) / MEM_PAGE_SIZE;
+    page_t * page = alloc->pages + idx;
+    int order = page->order;
+    ASSERT(!(page->flags & PAGE_FREE) && ((1 << order) >= page_count));
+    page->ref = 0;
+
+    // 伙伴也空闲时合并成更大的块
+    while (order < MEM_BUDDY_ORDER_MAX) {
+        int buddy_idx = idx ^ (1 << order);
+        if (buddy_idx + (1 << order) > alloc->page_count) {
+            break;
+        }
+        page_t * buddy = alloc->pages + buddy_idx;
+        if (!(buddy->flags & PAGE_FREE) || (buddy->order != order)) {
+            break;
+        }
+        list_remove(&alloc->free_list[order], &buddy->node);
+        buddy->flags &= ~PAGE_FREE;
+        idx &= ~(1 << order);
+        order++;
+    }
+    buddy_push(alloc, idx, order);
+
+    irq_leave_protection(state);
+}
+
+int memory_free_count(int order) {
+    if ((order < 0) || (order > MEM_BUDDY_ORDER_MAX)) {
+        return 0;
+    }
+    irq_state_t state = irq_enter_protection();
+    int count = list_count(&paddr_aloc.free_list[order]);
+    irq_leave_protection(state);
+    return count;
+}
+
+static void show_buddy_info(void) {
+    for (int i = 0; i <= MEM_BUDDY_ORDER_MAX; i++) {
+        log_printf("order %d: %d free", i, memory_free_count(i));
+    }
+}
 
-    int pg_idx = (addr - alloc->start) / alloc->page_size;
-    bitmap_set_bit(&alloc->bitmap, pg_idx, page_count, 0);
+// 释放一个用户物理页，只有最后一个引用者才真正释放
+static void page_release(uint32_t paddr) {
+    irq_state_t state = irq_enter_protection();
+    int ref = --page_ref(paddr)->ref;
+    irq_leave_protection(state);
 
-    mutex_unlock(&alloc->mutex);
+    if (ref == 0) {
+        addr_free_page(&paddr_aloc, paddr, 1);
+    }
 }
 
-void show_mem_info(boot_info_t * boot_info) {
+static void show_mem_info(boot_info_t * boot_info) {
     log_printf("memorty region:");
     for (int i = 0; i < boot_info->ram_region_count; i++) {
          log_printf("[%d]: 0x%x -> 0x%x", i, boot_info->ram_region_cfg[i].start, boot_info->ram_region_cfg[i].size);
@@ -65,18 +198,21 @@ pte_t * find_pte(pde_t * page_dir, uint32_t vaddr, int alloc) {
     pde_t * pde = page_dir + pde_index(vaddr);
 
     if (pde->present) {
+        // 4MB大页没有页表
+        if (pde->ps) {
+            return (pte_t *)0;
+        }
         page_table = (pte_t *)pde_paddr(pde);
     } else {
         if (alloc == 0) {
             return (pte_t *)0;
         }
-        uint32_t pg_addr = addr_alloc_page(&paddr_aloc, 1);
+        uint32_t pg_addr = memory_alloc_zeroed_page();
         if (pg_addr == 0) {
             return (pte_t *)0;
         }
         pde->v = pg_addr | PDE_P | PDE_W | PDE_U;
         page_table = (pte_t *)pg_addr;
-        kernel_memset(page_table, 0, MEM_PAGE_SIZE);
     }
     return page_table + pte_index(vaddr);
 }
@@ -99,6 +235,20 @@ int memory_create_map(pde_t * page_dir, uint32_t vaddr, uint32_t paddr, int coun
     return 0;
 }
 
+/**
+ * 用4MB大页建立映射，地址需按4MB对齐
+ */
+static void memory_create_large_map(pde_t * page_dir, uint32_t vaddr, uint32_t paddr, int count, uint32_t perm) {
+    for (int i = 0; i < count; i++) {
+        pde_t * pde = page_dir + pde_index(vaddr);
+        ASSERT(pde->present == 0);
+        pde->v = paddr | perm | PDE_PS | PDE_P;
+
+        vaddr += MEM_LARGE_PAGE_SIZE;
+        paddr += MEM_LARGE_PAGE_SIZE;
+    }
+}
+
 void create_kernel_table(void) {
     extern uint8_t kernel_base[], s_text[], e_text[], s_data[];
     static memory_map_t kernel_map[] = {
@@ -115,45 +265,86 @@ void create_kernel_table(void) {
         uint32_t vstart = down2((uint32_t)map->vstart, MEM_PAGE_SIZE);
         uint32_t vend = up2((uint32_t)map->vend, MEM_PAGE_SIZE);
         uint32_t pstart = down2((uint32_t)map->pstart, MEM_PAGE_SIZE);
-        int page_count = (vend - vstart) / MEM_PAGE_SIZE;
 
-        memory_create_map(kernel_page_dir, vstart, pstart, page_count, map->perm);
+        // 内核映射在所有进程中相同，标记为全局页，切换cr3时不被刷出TLB
+        uint32_t perm = map->perm | PTE_G;
+
+        // 中间4MB对齐的部分用大页，两端不足4MB的部分用4KB页
+        uint32_t large_start = up2(vstart, MEM_LARGE_PAGE_SIZE);
+        uint32_t large_end = down2(vend, MEM_LARGE_PAGE_SIZE);
+        if ((vstart - pstart) % MEM_LARGE_PAGE_SIZE || (large_start >= large_end)) {
+            large_start = large_end = vend;
+        }
+
+        memory_create_map(kernel_page_dir, vstart, pstart, (large_start - vstart) / MEM_PAGE_SIZE, perm);
+        memory_create_large_map(kernel_page_dir, large_start, pstart + (large_start - vstart),
+                (large_end - large_start) / MEM_LARGE_PAGE_SIZE, perm);
+        memory_create_map(kernel_page_dir, large_end, pstart + (large_end - vstart), (vend - large_end) / MEM_PAGE_SIZE, perm);
     }
 }
 
 void memory_init(boot_info_t * boot_info) {
-
-    extern uint8_t * mem_free_start;
-
-    uint8_t * mem_free = (uint8_t *)&mem_free_start;
-
-    log_printf("\nmemorty init...");
-    show_mem_info(boot_info);
-
     uint32_t mem_up1MB_free = total_mem_size(boot_info) - MEM_EXT_START;
     mem_up1MB_free = down2(mem_up1MB_free, MEM_PAGE_SIZE);
-    log_printf("free memory start: 0x%x, size: 0x%x", MEM_EXT_START, mem_up1MB_free);
 
-    addr_alloc_init(&paddr_aloc, mem_free, MEM_EXT_START, mem_up1MB_free, MEM_PAGE_SIZE);
-    mem_free += bitmap_byte_count(paddr_aloc.size / MEM_PAGE_SIZE);
+    addr_alloc_init(&paddr_aloc, MEM_EXT_START, mem_up1MB_free);
+    list_init(&zero_page_list);
+    zero_page_count = 0;
 
-    ASSERT(mem_free < (uint8_t *)MEM_EBDA_START);
+    // 加载器已打开，这里再确认一次
+    write_cr4(read_cr4() | CR4_PSE);
 
     create_kernel_table();
     mmu_set_page_dir((uint32_t)kernel_page_dir);
+    write_cr4(read_cr4() | CR4_PGE);
+
+    kmem_init();
+    vma_init();
+    memory_vdso_init();
+
+    // 内核态写只读页也触发异常，否则写时复制页会被内核直接改写
+    write_cr0(read_cr0() | CR0_WP);
+}
+
+// 日志设备依赖内存分配，因此内存信息在日志初始化之后再输出
+void memory_show_info(boot_info_t * boot_info) {
+    log_printf("\nmemorty init...");
+    show_mem_info(boot_info);
+    log_printf("free memory start: 0x%x, size: 0x%x", paddr_aloc.start, paddr_aloc.size);
+    show_buddy_info();
 }
 
-uint32_t memory_create_uvm(void) {
-    pde_t * page_dir = (pde_t *)addr_alloc_page(&paddr_aloc, 1);
+/**
+ * 创建用户地址空间，proc_page中返回进程页的内核地址，之后写入pid时不用查页表
+ */
+uint32_t memory_create_uvm(uint32_t * proc_page) {
+    pde_t * page_dir = (pde_t *)memory_alloc_zeroed_page();
     if (page_dir == 0) {
         return 0;
     }
-    kernel_memset((void *)page_dir, 0, MEM_PAGE_SIZE);
     uint32_t user_pde_start = pde_index(MEM_TASK_BASE);
     for (int i = 0; i < user_pde_start; i++) {
         page_dir[i].v = kernel_page_dir[i].v;
     }
+
+    // 用户只读的时间页和进程页，免去读取时的系统调用
+    uint32_t proc = memory_alloc_zeroed_page();
+    if (proc == 0) {
+        goto create_uvm_failed;
+    }
+    if (memory_create_map(page_dir, MEM_VDSO_PROC, proc, 1, PTE_U) < 0) {
+        addr_free_page(&paddr_aloc, proc, 1);
+        goto create_uvm_failed;
+    }
+    if (memory_create_map(page_dir, MEM_VDSO_TIME, vdso_time_page, 1, PTE_U) < 0) {
+        goto create_uvm_failed;
+    }
+    page_ref_inc(vdso_time_page);
+    *proc_page = proc;
     return (uint32_t)page_dir;
+create_uvm_failed:
+    memory_destroy_uvm((uint32_t)page_dir);
+    return 0;
 }
 
 int memory_alloc_for_page_dir(uint32_t page_dir, uint32_t vaddr, uint32_t size, int perm) {
@@ -161,7 +352,7 @@ int memory_alloc_for_page_dir(uint32_t page_dir, uint32_t vaddr, uint32_t size,
     int page_count = up2(size, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
 
     for (int i = 0; i < page_count; i++) {
-        uint32_t paddr = addr_alloc_page(&paddr_aloc, 1);
+        uint32_t paddr = memory_alloc_zeroed_page();
         if (paddr == 0) {
             log_printf("mem alloc failed. no memory");
             return 0;
@@ -177,7 +368,7 @@ int memory_alloc_for_page_dir(uint32_t page_dir, uint32_t vaddr, uint32_t size,
 }
 
 int memory_alloc_page_for(uint32_t vaddr, uint32_t size, int perm) {
-    return memory_alloc_for_page_dir(task_current()->tss.cr3, vaddr, size, perm);
+    return memory_alloc_for_page_dir(task_current()->mm->page_dir, vaddr, size, perm);
 }
 
 uint32_t memory_alloc_page(void) {
@@ -185,8 +376,94 @@ uint32_t memory_alloc_page(void) {
     return addr;
 }
 
+uint32_t memory_alloc_pages(int page_count) {
+    return addr_alloc_page(&paddr_aloc, page_count);
+}
+
+static void page_zero(uint32_t page) {
+    uint32_t * p = (uint32_t *)page;
+    for (int i = 0; i < MEM_PAGE_SIZE / sizeof(uint32_t); i++) {
+        p[i] = 0;
+    }
+}
+
+/**
+ * 分配所有进程共享的时间页，由时钟驱动写入，映射给用户只读
+ */
+void memory_vdso_init(void) {
+    vdso_time_page = addr_alloc_page(&paddr_aloc, 1);
+    ASSERT(vdso_time_page != 0);
+    page_zero(vdso_time_page);
+}
+
+// 时间页的内核地址
+void * memory_vdso_time(void) {
+    return (void *)vdso_time_page;
+}
+
+/**
+ * 写入进程页中的pid，只在建立地址空间及execve、vfork时调用，不在切换任务时写
+ * 共用地址空间的线程读到的是创建该地址空间的进程的pid
+ */
+void memory_vdso_set_pid(uint32_t proc_page, int pid) {
+    ((vdso_proc_t *)proc_page)->pid = pid;
+}
+
+/**
+ * 分配一页已清零的物理页，优先从预清零的页池中取
+ */
+uint32_t memory_alloc_zeroed_page(void) {
+    irq_state_t state = irq_enter_protection();
+    list_node_t * node = list_remove_first(&zero_page_list);
+    if (node) {
+        zero_page_count--;
+    }
+    irq_leave_protection(state);
+
+    if (node) {
+        page_t * page = field_2_parent(node, page_t, node);
+        return paddr_aloc.start + (page - paddr_aloc.pages) * MEM_PAGE_SIZE;
+    }
+
+    uint32_t addr = addr_alloc_page(&paddr_aloc, 1);
+    if (addr) {
+        page_zero(addr);
+    }
+    return addr;
+}
+
+/**
+ * 往页池中补充一页清零的页，池满或没有空闲内存时返回0
+ */
+int memory_fill_zero_pool(void) {
+    if (zero_page_count >= MEM_ZERO_POOL_SIZE) {
+        return 0;
+    }
+
+    uint32_t addr = addr_alloc_page(&paddr_aloc, 1);
+    if (addr == 0) {
+        return 0;
+    }
+    page_zero(addr);
+
+    irq_state_t state = irq_enter_protection();
+    list_insert_last(&zero_page_list, &page_ref(addr)->node);
+    zero_page_count++;
+    irq_leave_protection(state);
+    return 1;
+}
+
+void memory_release_page(uint32_t paddr) {
+    page_release(paddr);
+}
+
+page_t * memory_get_page(uint32_t paddr) {
+    ASSERT((paddr >= paddr_aloc.start) && (paddr < paddr_aloc.start + paddr_aloc.size));
+    return addr_to_page(&paddr_aloc, paddr);
+}
+
 static pde_t * curr_page_dir(void) {
-    return (pde_t *)(task_current()->tss.cr3);
+    return (pde_t *)(task_current()->mm->page_dir);
 }
 
 void memory_free_page(uint32_t addr) {
@@ -194,19 +471,21 @@ void memory_free_page(uint32_t addr) {
         addr_free_page(&paddr_aloc, addr, 1);
     } else {
         pte_t * pte = find_pte(curr_page_dir(), addr, 0);
-        ASSERT((pte == (pte_t *)0) && pte->present);
+        ASSERT((pte != (pte_t *)0) && pte->present);
 
-        addr_free_page(&paddr_aloc, pte_paddr(pte), 1);
+        page_release(pte_paddr(pte));
         pte->v = 0;
+        invlpg(addr);
     }
 }
 
-uint32_t memory_copy_uvm(uint32_t page_dir) {
-    uint32_t to_page_dir = memory_create_uvm();
+uint32_t memory_copy_uvm(uint32_t page_dir, uint32_t * proc_page) {
+    uint32_t to_page_dir = memory_create_uvm(proc_page);
     if (to_page_dir == 0) {
         goto copy_uvm_failed;
     }
 
+    // 父子进程共享物理页，可写页在双方都改为只读并标记为写时复制
     uint32_t user_pde_start = pde_index(MEM_TASK_BASE);
     pde_t * src_pde = (pde_t *)page_dir + user_pde_start;
     for (int i = user_pde_start; i < PDE_CNT; i++, src_pde++) {
@@ -218,18 +497,29 @@ uint32_t memory_copy_uvm(uint32_t page_dir) {
             if (!src_pte->present) {
                 continue;
             }
-            
-            uint32_t page = addr_alloc_page(&paddr_aloc, 1);
-            if (page == 0) {
-                goto copy_uvm_failed;
-            }
 
             uint32_t vaddr = (i << 22) | (j << 12);
-            int err = memory_create_map((pde_t *)to_page_dir, vaddr, page, 1, get_pte_perm(src_pte));
+            // 时间页和进程页已由memory_create_uvm建立
+            if ((vaddr >= MEM_VDSO_TIME) && (vaddr < MEM_VDSO_END)) {
+                continue;
+            }
+
+            // 共享映射的页在父子进程间保持可写
+            if ((src_pte->v & PTE_W) && !(src_pte->v & PTE_SHARED)) {
+                src_pte->v = (src_pte->v & ~PTE_W) | PTE_COW;
+                if (page_dir == read_cr3()) {
+                    invlpg(vaddr);
+                }
+            }
+
+            // 访问位和脏位只属于父进程，子进程没写过的共享页不应在解除映射时写回
+            uint32_t paddr = pte_paddr(src_pte);
+            uint32_t perm = get_pte_perm(src_pte) & ~(PTE_A | PTE_D);
+            int err = memory_create_map((pde_t *)to_page_dir, vaddr, paddr, 1, perm);
             if (err < 0) {
                 goto copy_uvm_failed;
             }
-            kernel_memcpy((void *)vaddr, (void *)page, MEM_PAGE_SIZE);
+            page_ref_inc(paddr);
         }
     }
 
@@ -238,7 +528,7 @@ copy_uvm_failed:
     if (to_page_dir) {
         memory_destroy_uvm(to_page_dir);
     }
-    return -1;
+    return 0;
 }
 
 
@@ -254,16 +544,191 @@ void memory_destroy_uvm(uint32_t page_dir) {
             if (!pte->present) {
                 continue;
             }
-            addr_free_page(&paddr_aloc, pte_paddr(pte), 1);
+            page_release(pte_paddr(pte));
         }
         addr_free_page(&paddr_aloc, pde_paddr(pde), 1);
     }
     addr_free_page(&paddr_aloc, page_dir, 1);
 }
 
+static int memory_copy_on_write(pte_t * pte, uint32_t vaddr) {
+    uint32_t paddr = pte_paddr(pte);
+    uint32_t perm = (get_pte_perm(pte) & ~PTE_COW) | PTE_W;
+
+    // 仍有其它页表共享该页时才需要复制，否则直接恢复写权限
+    if (page_ref_count(paddr) > 1) {
+        uint32_t page = addr_alloc_page(&paddr_aloc, 1);
+        if (page == 0) {
+            log_printf("copy on write failed. no memory");
+            return -1;
+        }
+        kernel_memcpy((void *)paddr, (void *)page, MEM_PAGE_SIZE);
+        page_release(paddr);
+        paddr = page;
+    }
+
+    pte->v = paddr | perm;
+    invlpg(vaddr);
+    return 0;
+}
+
+// 填充一页的内容，一页可能同时跨越多个ELF段以及bss、堆区域。page需已清零
+static int memory_fill_page(list_t * vma_list, uint32_t page_vaddr, uint32_t page, uint32_t * perm) {
+    *perm = 0;
+    uint32_t page_end = page_vaddr + MEM_PAGE_SIZE;
+    list_node_t * node = list_first(vma_list);
+    while (node) {
+        vma_t * vma = field_2_parent(node, vma_t, node);
+        node = list_node_next(node);
+
+        if ((vma->end <= page_vaddr) || (vma->start >= page_end)) {
+            continue;
+        }
+        *perm |= vma->perm;
+
+        if (!(vma->flags & VMA_FILE)) {
+            continue;
+        }
+        uint32_t start = vma->start > page_vaddr ? vma->start : page_vaddr;
+        uint32_t end = vma->start + vma->file_size;
+        if (end > page_end) {
+            end = page_end;
+        }
+        if (start >= end) {
+            continue;
+        }
+        int size = end - start;
+        int cnt = fs_read_file(vma->file, vma->file_offset + (start - vma->start), (char *)(page + start - page_vaddr), size);
+        if (cnt < size) {
+            log_printf("load page failed. vaddr: 0x%x", page_vaddr);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 首次访问某个区域内的页时才为其分配物理页
+static int memory_demand_page(uint32_t vaddr) {
+    task_t * task = task_current();
+    vma_t * vma = vma_find(&task->mm->vma_list, vaddr);
+    if (vma == (vma_t *)0) {
+        return -1;
+    }
+
+    // 共享内存段和共享映射的页由段统一管理，所有映射者都映射到同一物理页上
+    // 文件映射时段即为该文件的页缓存，页的序号按其在文件中的位置计算
+    if (vma->shm) {
+        uint32_t page_vaddr = down2(vaddr, MEM_PAGE_SIZE);
+        uint32_t index = (vma->file_offset + (page_vaddr - vma->start)) / MEM_PAGE_SIZE;
+        uint32_t page = shm_page(vma->shm, index);
+        if (page == 0) {
+            return -1;
+        }
+
+        // 读文件时可能发生了任务切换，其它路径已经映射了该页
+        pte_t * pte = find_pte(curr_page_dir(), page_vaddr, 0);
+        if (pte && pte->present) {
+            return 0;
+        }
+
+        if (memory_create_map(curr_page_dir(), page_vaddr, page, 1, vma->perm) < 0) {
+            return -1;
+        }
+        page_ref_inc(page);
+        return 0;
+    }
+
+    uint32_t page = memory_alloc_zeroed_page();
+    if (page == 0) {
+        log_printf("demand page failed. no memory");
+        return -1;
+    }
+
+    uint32_t perm;
+    uint32_t page_vaddr = down2(vaddr, MEM_PAGE_SIZE);
+    if (memory_fill_page(&task->mm->vma_list, page_vaddr, page, &perm) < 0) {
+        addr_free_page(&paddr_aloc, page, 1);
+        return -1;
+    }
+
+    // 读文件时可能发生了任务切换，其它路径已经映射了该页
+    pte_t * pte = find_pte(curr_page_dir(), page_vaddr, 0);
+    if (pte && pte->present) {
+        addr_free_page(&paddr_aloc, page, 1);
+        return 0;
+    }
+
+    if (memory_create_map(curr_page_dir(), page_vaddr, page, 1, perm) < 0) {
+        addr_free_page(&paddr_aloc, page, 1);
+        return -1;
+    }
+    return 0;
+}
+
+int memory_handle_page_fault(uint32_t vaddr, uint32_t err_code) {
+    // 内核任务没有用户地址空间，不处理其对用户区域的访问
+    if ((vaddr < MEM_TASK_BASE) || (task_current()->mm == (task_mm_t *)0)) {
+        return -1;
+    }
+
+    if (!(err_code & ERR_PAGE_P)) {
+        return memory_demand_page(vaddr);
+    }
+
+    if (err_code & ERR_PAGE_WR) {
+        pte_t * pte = find_pte(curr_page_dir(), vaddr, 0);
+        if (pte && pte->present && (pte->v & PTE_COW)) {
+            return memory_copy_on_write(pte, vaddr);
+        }
+    }
+    return -1;
+}
+
+int memory_prefault(uint32_t vaddr, uint32_t size) {
+    uint32_t end = vaddr + size;
+    for (uint32_t addr = down2(vaddr, MEM_PAGE_SIZE); addr < end; addr += MEM_PAGE_SIZE) {
+        if (addr < MEM_TASK_BASE) {
+            continue;
+        }
+        pte_t * pte = find_pte(curr_page_dir(), addr, 0);
+        if (pte && pte->present) {
+            continue;
+        }
+        if (memory_demand_page(addr) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 检查系统调用传入的用户缓冲区，须完整地落在进程的区域内，内核要写入时区域还须可写
+ * 通过后补齐缺页，之后内核访问它不会因缺页而重入文件系统，也不会写到只读页上
+ */
+int memory_check_user(uint32_t vaddr, uint32_t size, int write) {
+    if (size == 0) {
+        return 0;
+    }
+
+    uint32_t end = vaddr + size;
+    if ((vaddr < MEM_TASK_BASE) || (end < vaddr)) {
+        return -1;
+    }
+
+    list_t * vma_list = &task_current()->mm->vma_list;
+    for (uint32_t addr = vaddr; addr < end; ) {
+        vma_t * vma = vma_find(vma_list, addr);
+        if ((vma == (vma_t *)0) || (write && !(vma->perm & PTE_W))) {
+            return -1;
+        }
+        addr = vma->end;
+    }
+    return memory_prefault(vaddr, size);
+}
+
 uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr) {
     pte_t * pte = find_pte((pde_t *)page_dir, vaddr, 0);
-    if (!pte) {
+    if (!pte || !pte->present) {
         return 0;
     }
     return pte_paddr(pte) + (vaddr & (MEM_PAGE_SIZE - 1));
@@ -288,11 +753,164 @@ int memory_copy_uvm_data(uint32_t to, uint32_t page_dir, uint32_t from, uint32_t
     return 0;
 }
 
-char * sys_sbrk(int incr) {
+/**
+ * 解除一段区域的映射，共享的文件映射中被改写过的页先写回文件
+ */
+static void memory_unmap_vma(uint32_t page_dir, vma_t * vma) {
+    for (uint32_t vaddr = vma->start; vaddr < vma->end; vaddr += MEM_PAGE_SIZE) {
+        pte_t * pte = find_pte((pde_t *)page_dir, vaddr, 0);
+        if ((pte == (pte_t *)0) || !pte->present) {
+            continue;
+        }
+
+        uint32_t paddr = pte_paddr(pte);
+        if ((vma->flags & VMA_SHARED) && vma->file && pte->dirty) {
+            uint32_t file_end = vma->start + vma->file_size;
+            uint32_t size = file_end > vaddr ? file_end - vaddr : 0;
+            if (size > MEM_PAGE_SIZE) {
+                size = MEM_PAGE_SIZE;
+            }
+            if (size && (fs_write_file(vma->file, vma->file_offset + (vaddr - vma->start), (char *)paddr, size) < size)) {
+                log_printf("write back mmap page failed. vaddr: 0x%x", vaddr);
+            }
+        }
+
+        page_release(paddr);
+        pte->v = 0;
+        if (page_dir == read_cr3()) {
+            invlpg(vaddr);
+        }
+    }
+}
+
+void * sys_mmap(mmap_args_t * args) {
     task_t * task = task_current();
-    char * pre_heap_end = (char *)task->heap_end;
 
-    int pre_incr = incr;
+    if ((args == (mmap_args_t *)0) || (args->length <= 0)) {
+        return MAP_FAILED;
+    }
+    int shared = args->flags & MAP_SHARED;
+    if (!shared == !(args->flags & MAP_PRIVATE)) {
+        log_printf("mmap: one of MAP_SHARED and MAP_PRIVATE is required");
+        return MAP_FAILED;
+    }
+
+    file_t * file = (file_t *)0;
+    if (!(args->flags & MAP_ANONYMOUS)) {
+        file = task_file(args->fd);
+        if ((file == (file_t *)0) || (file->type != FILE_NORMAL)) {
+            log_printf("mmap: bad file %d", args->fd);
+            return MAP_FAILED;
+        }
+        if ((args->offset < 0) || (args->offset & (MEM_PAGE_SIZE - 1))) {
+            log_printf("mmap: offset not aligned");
+            return MAP_FAILED;
+        }
+        if (shared && (args->prot & PROT_WRITE) && (file->mode == O_RDONLY)) {
+            log_printf("mmap: file is read only");
+            return MAP_FAILED;
+        }
+    }
+
+    uint32_t perm = PTE_P | PTE_U;
+    if (args->prot & PROT_WRITE) {
+        perm |= PTE_W;
+    }
+    if (shared) {
+        perm |= PTE_SHARED;
+    }
+
+    // 优先使用给定的地址，不可用时在映射区中另找一块
+    uint32_t size = up2(args->length, MEM_PAGE_SIZE);
+    uint32_t mmap_end = MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE;
+    uint32_t start = (uint32_t)args->addr;
+    if ((start < MEM_TASK_MMAP_BASE) || (start & (MEM_PAGE_SIZE - 1)) ||
+            (vma_find_free(&task->mm->vma_list, start, mmap_end, size) != start)) {
+        start = vma_find_free(&task->mm->vma_list, MEM_TASK_MMAP_BASE, mmap_end, size);
+        if (start == 0) {
+            log_printf("mmap: no free space");
+            return MAP_FAILED;
+        }
+    }
+
+    int flags = VMA_MMAP | (file ? VMA_FILE : VMA_ANON) | (shared ? VMA_SHARED : 0);
+    vma_t * vma = vma_create(&task->mm->vma_list, start, start + size, perm, flags);
+    if (vma == (vma_t *)0) {
+        return MAP_FAILED;
+    }
+
+    // 页面在首次访问时才从文件中读入，文件末尾之后的部分为0
+    if (file) {
+        uint32_t file_size = file->size > args->offset ? file->size - args->offset : 0;
+        if (file_size > args->length) {
+            file_size = args->length;
+        }
+        vma_set_file(vma, file, args->offset, file_size);
+    }
+
+    // 共享映射的页放在段中，fork出的进程及映射同一文件的进程看到的是同一组物理页
+    if (shared) {
+        vma->shm = file ? shm_get_file(file, args->offset + size) : shm_create_anon(size);
+        if (vma->shm == (struct _shm_t *)0) {
+            vma_destroy(&task->mm->vma_list, vma);
+            return MAP_FAILED;
+        }
+    }
+    return (void *)start;
+}
+
+int sys_munmap(void * addr, int length) {
+    task_t * task = task_current();
+    uint32_t start = (uint32_t)addr;
+    uint32_t end = start + up2(length, MEM_PAGE_SIZE);
+
+    if ((length <= 0) || (start & (MEM_PAGE_SIZE - 1)) || (end <= start)) {
+        return -1;
+    }
+
+    // 与范围部分重叠的区域先拆开，范围外的部分保留
+    int count = 0;
+    list_node_t * node = list_first(&task->mm->vma_list);
+    while (node) {
+        vma_t * vma = field_2_parent(node, vma_t, node);
+        node = list_node_next(node);
+
+        if (!(vma->flags & VMA_MMAP) || (vma->end <= start) || (vma->start >= end)) {
+            continue;
+        }
+        if (vma->start < start) {
+            vma = vma_split(&task->mm->vma_list, vma, start);
+            if (vma == (vma_t *)0) {
+                return -1;
+            }
+        }
+        if ((vma->end > end) && (vma_split(&task->mm->vma_list, vma, end) == (vma_t *)0)) {
+            return -1;
+        }
+
+        memory_unmap_vma(task->mm->page_dir, vma);
+        vma_destroy(&task->mm->vma_list, vma);
+        count++;
+    }
+    return count ? 0 : -1;
+}
+
+void memory_munmap_all(uint32_t page_dir, list_t * vma_list) {
+    list_node_t * node = list_first(vma_list);
+    while (node) {
+        vma_t * vma = field_2_parent(node, vma_t, node);
+        node = list_node_next(node);
+
+        if (vma->flags & VMA_MMAP) {
+            memory_unmap_vma(page_dir, vma);
+            vma_destroy(vma_list, vma);
+        }
+    }
+}
+
+char * sys_sbrk(int incr) {
+    task_t * task = task_current();
+    char * pre_heap_end = (char *)task->mm->heap_end;
 
     ASSERT(incr >= 0);
 
@@ -301,31 +919,23 @@ char * sys_sbrk(int incr) {
         return pre_heap_end;
     }
 
-    uint32_t start = task->heap_end;
-    uint32_t end = start + incr;
-
-    uint32_t start_offset = start % MEM_PAGE_SIZE;
-    if (start_offset) {
-        if (start_offset + incr <= MEM_PAGE_SIZE) {
-            task->heap_end = end;
-            return pre_heap_end;
-        } else {
-            uint32_t curr_size = MEM_PAGE_SIZE - start_offset;
-            start += curr_size;
-            incr -= curr_size;
-        }
-    }
-    if (incr) {
-        uint32_t curr_size = end - start;
-        int err = memory_alloc_page_for(start, curr_size, PTE_P | PTE_W | PTE_U);
-        if (err < 0) {
+    // 只扩大堆区域的范围，物理页在首次访问时再分配
+    vma_t * heap = vma_find_flags(&task->mm->vma_list, VMA_HEAP);
+    if (heap == (vma_t *)0) {
+        heap = vma_create(&task->mm->vma_list, task->mm->heap_start, task->mm->heap_end, PTE_P | PTE_W | PTE_U, VMA_ANON | VMA_HEAP);
+        if (heap == (vma_t *)0) {
             log_printf("sbrk: alloc mem failed.");
             return (char *)-1;
         }
     }
 
-    //log_printf("sbrk(%d): end=0x%x", pre_incr, end);
-    task->heap_end = end;
+    if (task->mm->heap_end + incr > MEM_TASK_MMAP_BASE) {
+        log_printf("sbrk: heap overflow.");
+        return (char *)-1;
+    }
+
+    task->mm->heap_end += incr;
+    heap->end = task->mm->heap_end;
 
-    return (char *)pre_heap_end;
-}
\ No newline at end of file
+    return pre_heap_end;
+}
@@ -0,0 +1,177 @@
+#include "core/slab.h"
+#include "core/memory.h"
+#include "cpu/irq.h"
+#include "tools/klib.h"
+#include "tools/list.h"
+#include "tools/log.h"
+
+
+static kmem_cache_t kmalloc_caches[KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1];
+static const char * kmalloc_names[] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128", 
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+static inline uint32_t slab_obj_start(void) {
+    return up2(sizeof(slab_t), SLAB_ALIGN);
+}
+
+void kmem_cache_init(kmem_cache_t * cache, const char * name, int obj_size) {
+    kernel_memset(cache, 0, sizeof(kmem_cache_t));
+    cache->name = name;
+    cache->obj_size = up2(obj_size, SLAB_ALIGN);
+
+    // 每块slab至少容纳若干个对象，避免大对象浪费过多空间
+    int order = 0;
+    int per_slab = 0;
+    for (; order <= SLAB_ORDER_MAX; order++) {
+        per_slab = ((MEM_PAGE_SIZE << order) - slab_obj_start()) / cache->obj_size;
+        if (per_slab >= SLAB_MIN_OBJ_CNT) {
+            break;
+        }
+    }
+    if (order > SLAB_ORDER_MAX) {
+        order = SLAB_ORDER_MAX;
+    }
+    ASSERT(per_slab > 0);
+
+    cache->order = order;
+    cache->obj_per_slab = per_slab;
+    list_init(&cache->partial_list);
+    list_init(&cache->full_list);
+    list_init(&cache->empty_list);
+}
+
+static slab_t * slab_create(kmem_cache_t * cache) {
+    int page_count = 1 << cache->order;
+    uint32_t addr = memory_alloc_pages(page_count);
+    if (addr == 0) {
+        log_printf("slab %s: no memory", cache->name);
+        return (slab_t *)0;
+    }
+
+    slab_t * slab = (slab_t *)addr;
+    slab->cache = cache;
+    slab->inuse = 0;
+    list_node_init(&slab->node);
+
+    // 空闲对象串成单链表，链接指针存放在对象自身中
+    slab->free_obj = (void *)0;
+    uint8_t * obj = (uint8_t *)addr + slab_obj_start() + (cache->obj_per_slab - 1) * cache->obj_size;
+    for (int i = 0; i < cache->obj_per_slab; i++, obj -= cache->obj_size) {
+        *(void **)obj = slab->free_obj;
+        slab->free_obj = obj;
+    }
+
+    for (int i = 0; i < page_count; i++) {
+        memory_get_page(addr + i * MEM_PAGE_SIZE)->slab = slab;
+    }
+    return slab;
+}
+
+static void slab_destroy(slab_t * slab) {
+    int page_count = 1 << slab->cache->order;
+    uint32_t addr = (uint32_t)slab;
+    for (int i = 0; i < page_count; i++) {
+        memory_get_page(addr + i * MEM_PAGE_SIZE)->slab = (void *)0;
+    }
+    memory_free_page(addr);
+}
+
+void * kmem_cache_alloc(kmem_cache_t * cache) {
+    irq_state_t state = irq_enter_protection();
+
+    slab_t * slab;
+    list_node_t * node = list_first(&cache->partial_list);
+    if (node) {
+        slab = field_2_parent(node, slab_t, node);
+    } else {
+        node = list_remove_first(&cache->empty_list);
+        if (node) {
+            slab = field_2_parent(node, slab_t, node);
+        } else {
+            slab = slab_create(cache);
+            if (slab == (slab_t *)0) {
+                irq_leave_protection(state);
+                return (void *)0;
+            }
+        }
+        list_insert_first(&cache->partial_list, &slab->node);
+    }
+
+    void * obj = slab->free_obj;
+    slab->free_obj = *(void **)obj;
+    if (++slab->inuse == cache->obj_per_slab) {
+        list_remove(&cache->partial_list, &slab->node);
+        list_insert_first(&cache->full_list, &slab->node);
+    }
+    cache->inuse++;
+
+    irq_leave_protection(state);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t * cache, void * obj) {
+    irq_state_t state = irq_enter_protection();
+
+    slab_t * slab = (slab_t *)memory_get_page((uint32_t)obj)->slab;
+    ASSERT((slab != (slab_t *)0) && (slab->cache == cache));
+
+    *(void **)obj = slab->free_obj;
+    slab->free_obj = obj;
+
+    if (slab->inuse-- == cache->obj_per_slab) {
+        list_remove(&cache->full_list, &slab->node);
+    } else {
+        list_remove(&cache->partial_list, &slab->node);
+    }
+
+    // 只保留一块空的slab备用，多余的归还给页分配器
+    if (slab->inuse == 0) {
+        if (list_is_empty(&cache->empty_list)) {
+            list_insert_first(&cache->empty_list, &slab->node);
+        } else {
+            slab_destroy(slab);
+        }
+    } else {
+        list_insert_first(&cache->partial_list, &slab->node);
+    }
+    cache->inuse--;
+
+    irq_leave_protection(state);
+}
+
+void kmem_init(void) {
+    for (int i = 0; i < sizeof(kmalloc_caches) / sizeof(kmalloc_caches[0]); i++) {
+        kmem_cache_init(kmalloc_caches + i, kmalloc_names[i], 1 << (KMALLOC_MIN_SHIFT + i));
+    }
+}
+
+void * kmalloc(int size) {
+    if (size <= 0) {
+        return (void *)0;
+    }
+
+    for (int i = 0; i < sizeof(kmalloc_caches) / sizeof(kmalloc_caches[0]); i++) {
+        if (size <= (1 << (KMALLOC_MIN_SHIFT + i))) {
+            return kmem_cache_alloc(kmalloc_caches + i);
+        }
+    }
+
+    // 大块内存直接从页分配器获取
+    int page_count = up2(size, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    return (void *)memory_alloc_pages(page_count);
+}
+
+void kfree(void * ptr) {
+    if (ptr == (void *)0) {
+        return;
+    }
+
+    slab_t * slab = (slab_t *)memory_get_page((uint32_t)ptr)->slab;
+    if (slab) {
+        kmem_cache_free(slab->cache, ptr);
+    } else {
+        memory_free_page((uint32_t)ptr);
+    }
+}
@@ -1,9 +1,15 @@
 #include "core/syscall.h"
+#include "applib/lib_syscall.h"
 #include "comm/types.h"
 #include "core/memory.h"
+#include "core/sysring.h"
 #include "core/task.h"
+#include "core/vma.h"
+#include "cpu/mmu.h"
+#include "dev/time.h"
 #include "cpu/cpu.h"
 #include "fs/fs.h"
+#include "ipc/shm.h"
 #include "tools/log.h"
 
 typedef int (*syscall_handler_t)(uint32_t arg0, uint32_t arg1, uint32_t arg2,
@@ -29,6 +35,22 @@ static const syscall_handler_t sys_table[] = {
     [SYS_dup] = (syscall_handler_t)sys_dup,
     [SYS_exit] = (syscall_handler_t)sys_exit,
     [SYS_wait] = (syscall_handler_t)sys_wait,
+    [SYS_waitpid] = (syscall_handler_t)sys_waitpid,
+    [SYS_vfork] = (syscall_handler_t)sys_vfork,
+    [SYS_spawn] = (syscall_handler_t)sys_spawn,
+    [SYS_clone] = (syscall_handler_t)sys_clone,
+    [SYS_ring_setup] = (syscall_handler_t)sys_ring_setup,
+    [SYS_ring_enter] = (syscall_handler_t)sys_ring_enter,
+    [SYS_mmap] = (syscall_handler_t)sys_mmap,
+    [SYS_munmap] = (syscall_handler_t)sys_munmap,
+    [SYS_shmget] = (syscall_handler_t)sys_shmget,
+    [SYS_shmat] = (syscall_handler_t)sys_shmat,
+    [SYS_shmdt] = (syscall_handler_t)sys_shmdt,
+    [SYS_shmrm] = (syscall_handler_t)sys_shmrm,
+    [SYS_setpriority] = (syscall_handler_t)sys_setpriority,
+    [SYS_getpriority] = (syscall_handler_t)sys_getpriority,
+    [SYS_clock_gettime] = (syscall_handler_t)sys_clock_gettime,
+    [SYS_nanosleep] = (syscall_handler_t)sys_nanosleep,
     [SYS_opendir] = (syscall_handler_t)sys_opendir,
     [SYS_readdir] = (syscall_handler_t)sys_readdir,
     [SYS_closedir] = (syscall_handler_t)sys_closedir,
@@ -48,4 +70,90 @@ void do_handler_syscall(syscall_frame_t *frame) {
   task_t *curr_task = task_current();
   log_printf("task: %s, Unknown syscall: %d", curr_task->name, frame->func_id);
   frame->eax = -1;
-}
\ No newline at end of file
+}
+
+/**
+ * 环中只允许不依赖系统调用栈帧的文件操作
+ */
+static int sysring_allowed(int id) {
+  switch (id) {
+    case SYS_open:
+    case SYS_read:
+    case SYS_write:
+    case SYS_lseek:
+    case SYS_close:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * 环须完整地位于一个可写的区域内，否则内核访问时的缺页无法处理
+ */
+static int sysring_check(sysring_t *ring) {
+  uint32_t start = (uint32_t)ring;
+  uint32_t end = start + sizeof(sysring_t);
+  if ((start < MEM_TASK_BASE) || (end < start) || (end > MEM_TASK_STACK_TOP)) {
+    return -1;
+  }
+
+  vma_t *vma = vma_find(&task_current()->mm->vma_list, start);
+  if ((vma == (vma_t *)0) || (end > vma->end) || !(vma->perm & PTE_W)) {
+    return -1;
+  }
+  return 0;
+}
+
+int sys_ring_setup(sysring_t *ring) {
+  task_t *curr_task = task_current();
+  if (ring == (sysring_t *)0) {
+    curr_task->ring = (sysring_t *)0;
+    return 0;
+  }
+
+  if (sysring_check(ring) < 0) {
+    return -1;
+  }
+  curr_task->ring = ring;
+  return 0;
+}
+
+/**
+ * 依次处理环中已提交的调用，完成队列满时提前返回
+ */
+int sys_ring_enter(int to_submit) {
+  sysring_t *ring = task_current()->ring;
+  if (ring == (sysring_t *)0) {
+    return -1;
+  }
+
+  // 登记后区域可能已被解除映射，重新检查并补齐缺页
+  if ((sysring_check(ring) < 0) || (memory_prefault((uint32_t)ring, sizeof(sysring_t)) < 0)) {
+    return -1;
+  }
+
+  int count = 0;
+  while ((count < to_submit) && (ring->sq_head != ring->sq_tail)) {
+    if (ring->cq_tail - ring->cq_head >= SYSRING_ENTRIES) {
+      break;
+    }
+
+    // 先复制出来，执行期间用户修改提交项不影响本次调用
+    sysring_sqe_t sqe = ring->sq[ring->sq_head & (SYSRING_ENTRIES - 1)];
+    ring->sq_head++;
+
+    int ret = -1;
+    if (sysring_allowed(sqe.id)) {
+      syscall_handler_t handler = sys_table[sqe.id];
+      ret = handler(sqe.args[0], sqe.args[1], sqe.args[2], sqe.args[3]);
+    }
+
+    sysring_cqe_t *cqe = ring->cq + (ring->cq_tail & (SYSRING_ENTRIES - 1));
+    cqe->ret = ret;
+    cqe->user_data = sqe.user_data;
+    ring->cq_tail++;
+    count++;
+  }
+  return count;
+}
@@ -1,8 +1,13 @@
 #include "core/task.h"
 #include "comm/elf.h"
 #include "core/memory.h"
+#include "core/slab.h"
 #include "core/syscall.h"
+#include "core/timer.h"
+#include "dev/time.h"
+#include "core/vma.h"
 #include "cpu/cpu.h"
+#include "cpu/fpu.h"
 #include "cpu/irq.h"
 #include "cpu/mmu.h"
 #include "fs/file.h"
@@ -20,13 +25,15 @@
 
 
 static task_manager_t task_manager;
-static task_t task_table[TASK_NR];
-static mutex_t task_table_mutex;
+static uint32_t pid_bits[(TASK_PID_MAX + 1) / BITMAP_WORD_BITS];
+static kmem_cache_t task_cache;
+static kmem_cache_t mm_cache;
+static kmem_cache_t files_cache;
 
 
 file_t * task_file(int fd) {
     if (fd >= 0 && fd < TASK_OFILE_NR) {
-        file_t * file = task_current()->file_table[fd];
+        file_t * file = task_current()->files->table[fd];
         return file;
     }
     return (file_t *)0;
@@ -35,9 +42,9 @@ file_t * task_file(int fd) {
 int task_alloc_fd(file_t * file) {
     task_t * task = task_current();
     for (int i = 0; i < TASK_OFILE_NR; i++) {
-        file_t * p = task->file_table[i];
+        file_t * p = task->files->table[i];
         if (p == (file_t *)0) {
-            task->file_table[i] = file;
+            task->files->table[i] = file;
             return i;
         }
     }
@@ -46,88 +53,213 @@ int task_alloc_fd(file_t * file) {
 
 void task_remove_fd(int fd) {
     if (fd >= 0 && fd < TASK_OFILE_NR) {
-        task_current()->file_table[fd] = (file_t *)0;
+        task_current()->files->table[fd] = (file_t *)0;
     }
 }
 
 
-static int tss_init(task_t * task, int flag, uint32_t entry, uint32_t esp) {
-    int tss_sel = gdt_alloc_desc();
-    if (tss_sel < 0) {
-        log_printf("alloc tss failed.");
-        return -1;
-    }
-
-    segment_desc_set(tss_sel, (uint32_t)&task->tss, sizeof(tss_t), 
-    SEG_P_PRESENT | SEG_DPL0 | SEG_TYPE_TSS
-    );
+// 新任务第一次被切换到时内核栈上的内容
+typedef struct _task_frame_t {
+    // simple_switch弹出的寄存器及返回地址，返回到task_entry
+    uint32_t s_edi, s_esi, s_ebx, s_ebp, ret;
 
-    kernel_memset(&task->tss, 0, sizeof(tss_t));
+    // task_entry依次恢复段寄存器、通用寄存器，再经iret进入任务
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, dummy, ebx, edx, ecx, eax;
+    uint32_t eip, cs, eflags, esp, ss;
+}task_frame_t;
 
+static int task_stack_init(task_t * task, int flag, uint32_t entry, uint32_t esp) {
     uint32_t kernel_stack = memory_alloc_page();
     if (kernel_stack == 0) {
-        goto tss_init_failed;
+        log_printf("alloc kernel stack failed.");
+        return -1;
     }
 
     int code_sel, data_sel;
+    task_frame_t * frame;
     if (flag & TASK_FLAGS_SYSTEM) {
+        // 内核任务不切换特权级，直接在给定的栈上运行，未指定时使用内核栈
         code_sel = KERNEL_SELECTOR_CS;
         data_sel = KERNEL_SELECTOR_DS;
+        if (esp == 0) {
+            esp = kernel_stack + MEM_PAGE_SIZE;
+        }
+        frame = (task_frame_t *)(esp - sizeof(task_frame_t));
     } else {
         code_sel = task_manager.app_code_sel | SEG_CPL3;
         data_sel = task_manager.app_data_sel | SEG_CPL3;
+        frame = (task_frame_t *)(kernel_stack + MEM_PAGE_SIZE - sizeof(task_frame_t));
     }
-    
-    task->tss.eip = entry;
-    task->tss.esp = esp;
-    task->tss.esp0 = kernel_stack + MEM_PAGE_SIZE;
-    task->tss.ss = data_sel;
-    task->tss.ss0 = KERNEL_SELECTOR_DS;
-    task->tss.es = task->tss.ds = task->tss.fs = task->tss.gs = data_sel;
-    task->tss.cs = code_sel;
-    task->tss.eflags = EFLAGS_DEFAULT | EFLAGS_IF;
-    task->tss_sel = tss_sel;
-
-    uint32_t page_dir = memory_create_uvm();
-    if (page_dir == 0) {
-        goto tss_init_failed;
-    }
-    task->tss.cr3 = page_dir;
 
+    kernel_memset(frame, 0, sizeof(task_frame_t));
+    frame->ret = (uint32_t)task_entry;
+    frame->gs = frame->fs = frame->es = frame->ds = data_sel;
+    frame->eip = entry;
+    frame->cs = code_sel;
+    frame->eflags = EFLAGS_DEFAULT | EFLAGS_IF;
+    frame->esp = esp;
+    frame->ss = data_sel;
+
+    task->stack = (uint32_t *)frame;
+    task->kernel_stack = kernel_stack;
     return 0;
-tss_init_failed:
-    gdt_free_desc(tss_sel);
-    if (kernel_stack) {
-        memory_free_page(kernel_stack);
+}
+
+static task_mm_t * task_mm_create(void) {
+    task_mm_t * mm = (task_mm_t *)kmem_cache_alloc(&mm_cache);
+    if (mm == (task_mm_t *)0) {
+        return (task_mm_t *)0;
+    }
+
+    mm->page_dir = memory_create_uvm(&mm->proc_page);
+    if (mm->page_dir == 0) {
+        kmem_cache_free(&mm_cache, mm);
+        return (task_mm_t *)0;
+    }
+    mm->ref = 1;
+    list_init(&mm->vma_list);
+    mm->heap_start = mm->heap_end = 0;
+    return mm;
+}
+
+static task_mm_t * task_mm_get(task_mm_t * mm) {
+    irq_state_t state = irq_enter_protection();
+    mm->ref++;
+    irq_leave_protection(state);
+    return mm;
+}
+
+/**
+ * 最后一个使用者释放时写回共享映射，回收整个地址空间，此时不能正在使用这个页表
+ */
+static void task_mm_put(task_mm_t * mm) {
+    irq_state_t state = irq_enter_protection();
+    int ref = --mm->ref;
+    irq_leave_protection(state);
+    if (ref > 0) {
+        return;
+    }
+
+    memory_munmap_all(mm->page_dir, &mm->vma_list);
+    memory_destroy_uvm(mm->page_dir);
+    vma_destroy_all(&mm->vma_list);
+    kmem_cache_free(&mm_cache, mm);
+}
+
+static task_files_t * task_files_create(void) {
+    task_files_t * files = (task_files_t *)kmem_cache_alloc(&files_cache);
+    if (files) {
+        kernel_memset(files, 0, sizeof(task_files_t));
+        files->ref = 1;
+    }
+    return files;
+}
+
+static task_files_t * task_files_get(task_files_t * files) {
+    irq_state_t state = irq_enter_protection();
+    files->ref++;
+    irq_leave_protection(state);
+    return files;
+}
+
+static void task_files_put(task_files_t * files) {
+    irq_state_t state = irq_enter_protection();
+    int ref = --files->ref;
+    irq_leave_protection(state);
+    if (ref > 0) {
+        return;
+    }
+
+    for (int fd = 0; fd < TASK_OFILE_NR; fd++) {
+        if (files->table[fd]) {
+            fs_close_file(files->table[fd]);
+        }
+    }
+    kmem_cache_free(&files_cache, files);
+}
+
+static task_t * task_pid_lookup(int pid) {
+    list_node_t * node = list_first(&task_manager.pid_hash[pid % TASK_PID_HASH_SIZE]);
+    while (node) {
+        task_t * task = field_2_parent(node, task_t, pid_node);
+        if (task->pid == pid) {
+            return task;
+        }
+        node = list_node_next(node);
+    }
+    return (task_t *)0;
+}
+
+/**
+ * 顺序分配pid，回绕之后跳过仍在使用的，全部用完时返回-1
+ */
+static int task_alloc_pid(void) {
+    return bitmap_alloc_nbits(&task_manager.pid_map, 0, 1);
+}
+
+static void task_free_pid(int pid) {
+    if (pid >= TASK_PID_REUSE) {
+        bitmap_set_bit(&task_manager.pid_map, pid, 1, 0);
     }
-    return -1;
 }
 
 int task_init(task_t * task, char * name, int flag, uint32_t entry, uint32_t esp) {
     ASSERT(task != (task_t *)0);
-    tss_init(task, flag, entry, esp);
+    int err = task_stack_init(task, flag, entry, esp);
+    if (err < 0) {
+        return err;
+    }
+
+    // 共用地址空间时由调用者设置mm，内核任务只使用内核空间，不需要mm
+    int need_mm = !(flag & (TASK_FLAGS_SHARE_VM | TASK_FLAGS_SYSTEM));
+    task->mm = need_mm ? task_mm_create() : (task_mm_t *)0;
+    task->files = task_files_create();
+    task->fpu = (struct _fpu_state_t *)0;
+    task->ring = (struct _sysring_t *)0;
+    if ((need_mm && (task->mm == (task_mm_t *)0)) || (task->files == (task_files_t *)0)) {
+        goto task_init_failed;
+    }
 
     list_node_init(&task->run_node);
     list_node_init(&task->all_node);
+    list_node_init(&task->pid_node);
     list_node_init(&task->wait_node);
-
-    kernel_memset(&task->file_table, 0, sizeof(task->file_table));
+    list_node_init(&task->child_node);
+    list_init(&task->child_list);
+    list_init(&task->zombie_list);
 
     task->state = TASK_CREATED;
-    task->time_ticks = TASK_TIME_SLICE_DEFAULT;
-    task->slice_ticks = task->time_ticks;
+    task->base_prio = task->prio = TASK_PRIO_DEFAULT;
+    task->slice_end = 0;
     kernel_strncpy(name, task->name, TASK_NAME_SIZE);
-    task->sleep_ticks = 0;
-    task->pid = (uint32_t)task;
     task->parent = (task_t *)0;
-    task->heap_start = 0;
-    task->heap_end = 0;
     task->status = 0;
 
     irq_state_t state = irq_enter_protection();
+    task->pid = task_alloc_pid();
+    if (task->pid < 0) {
+        irq_leave_protection(state);
+        log_printf("no free pid");
+        goto task_init_failed;
+    }
+    list_insert_last(&task_manager.pid_hash[task->pid % TASK_PID_HASH_SIZE], &task->pid_node);
     list_insert_last(&task_manager.task_list, &task->all_node);
     irq_leave_protection(state);
+
+    if (need_mm) {
+        memory_vdso_set_pid(task->mm->proc_page, task->pid);
+    }
     return 0;
+task_init_failed:
+    if (task->mm) {
+        task_mm_put(task->mm);
+    }
+    if (task->files) {
+        task_files_put(task->files);
+    }
+    memory_free_page(task->kernel_stack);
+    return -1;
 }
 
 void task_start(task_t * task) {
@@ -137,47 +269,79 @@ void task_start(task_t * task) {
 }
 
 void task_uninit(task_t * task) {
-    if (task->tss_sel) {
-        gdt_free_desc(task->tss_sel);
+    irq_state_t state = irq_enter_protection();
+    list_remove(&task_manager.task_list, &task->all_node);
+    list_remove(&task_manager.pid_hash[task->pid % TASK_PID_HASH_SIZE], &task->pid_node);
+    task_free_pid(task->pid);
+    irq_leave_protection(state);
+
+    if (task->kernel_stack) {
+        memory_free_page(task->kernel_stack);
     }
-    if (task->tss.esp0) {
-        memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
+    if (task->mm) {
+        task_mm_put(task->mm);
     }
-    if (task->tss.cr3) {
-        memory_destroy_uvm(task->tss.cr3);
+    if (task->files) {
+        task_files_put(task->files);
     }
+    fpu_release(task);
     kernel_memset(task, 0, sizeof(task_t));
 }
 
-void simple_switch(uint32_t ** from, uint32_t * to);
-
 void task_switch_from_to(task_t * from, task_t * to) {
-    switch_to_tss(to->tss_sel);
+    // 进入内核态时使用新任务的内核栈
+    task_manager.tss.esp0 = to->kernel_stack + MEM_PAGE_SIZE;
+    fpu_switch(to);
+
+    // 内核任务沿用上一个任务的页表，内核空间在所有页表中都相同，省去刷新TLB
+    if (to->mm) {
+        if (to->mm->page_dir != read_cr3()) {
+            mmu_set_page_dir(to->mm->page_dir);
+        }
+    }
+    simple_switch(&from->stack, to->stack);
 }
 
 static uint32_t idle_task_stack[IDLE_TASK_STACK_SIZE];
 static void idle_task_entry(void) {
     for (;;) {
-        hlt();
+        // 空闲时预先清零一些物理页，页池满了才停机等待中断
+        if (!memory_fill_zero_pool()) {
+            hlt();
+        }
     }
 }
 
 void task_manager_init(void) {
 
-    kernel_memset(task_table, 0, sizeof(task_table));
-    mutex_init(&task_table_mutex);
+    kmem_cache_init(&task_cache, "task", sizeof(task_t));
+    kmem_cache_init(&mm_cache, "task_mm", sizeof(task_mm_t));
+    kmem_cache_init(&files_cache, "task_files", sizeof(task_files_t));
 
-    int data_sel = gdt_alloc_desc();
-    segment_desc_set(data_sel, 0x00000000, 0xFFFFFFFF, SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_DATA | SEG_TYPE_RW | SEG_D);
-    task_manager.app_data_sel = data_sel;
+    // 应用程序的代码段、数据段位置固定，已在gdt_init中设置
+    task_manager.app_data_sel = APP_SELECTOR_DS;
+    task_manager.app_code_sel = APP_SELECTOR_CS;
 
-    int code_sel = gdt_alloc_desc();
-    segment_desc_set(code_sel, 0x00000000, 0xFFFFFFFF, SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_CODE | SEG_TYPE_RW | SEG_D);
-    task_manager.app_code_sel = code_sel;
-
-    list_init(&task_manager.ready_list);
+    int tss_sel = gdt_alloc_desc();
+    kernel_memset(&task_manager.tss, 0, sizeof(tss_t));
+    task_manager.tss.ss0 = KERNEL_SELECTOR_DS;
+    task_manager.tss.iomap = sizeof(tss_t);
+    segment_desc_set(tss_sel, (uint32_t)&task_manager.tss, sizeof(tss_t), SEG_P_PRESENT | SEG_DPL0 | SEG_TYPE_TSS);
+    write_tr(tss_sel);
+    task_manager.tss_sel = tss_sel;
+    cpu_sysenter_set_stack(&task_manager.tss);
+
+    for (int i = 0; i < TASK_PRIO_NR; i++) {
+        list_init(&task_manager.ready_list[i]);
+    }
+    task_manager.ready_bitmap = 0;
+    task_manager.ready_count = 0;
+    task_manager.boost_time = 0;
     list_init(&task_manager.task_list);
-    list_init(&task_manager.sleep_list);
+    for (int i = 0; i < TASK_PID_HASH_SIZE; i++) {
+        list_init(&task_manager.pid_hash[i]);
+    }
+    bitmap_init(&task_manager.pid_map, (uint8_t *)pid_bits, TASK_PID_MAX + 1, 0);
     task_manager.curr_task = (task_t *)0;
     
     task_init(&task_manager.idle_task, "idle task", TASK_FLAGS_SYSTEM, (uint32_t)idle_task_entry, (uint32_t)(idle_task_stack + IDLE_TASK_STACK_SIZE));
@@ -196,13 +360,14 @@ void task_first_init(void) {
     uint32_t first_start = (uint32_t)first_task_entry;
 
     task_init(&task_manager.first_task, "first task", 0, first_start, first_start + alloc_size);
-    task_manager.first_task.heap_start = (uint32_t)e_first_task;
-    task_manager.first_task.heap_end = (uint32_t)e_first_task;
-    write_tr(task_manager.first_task.tss_sel);
+    task_manager.first_task.mm->heap_start = (uint32_t)e_first_task;
+    task_manager.first_task.mm->heap_end = (uint32_t)e_first_task;
     task_manager.curr_task = &task_manager.first_task;
+    task_manager.tss.esp0 = task_manager.first_task.kernel_stack + MEM_PAGE_SIZE;
 
-    mmu_set_page_dir(task_manager.first_task.tss.cr3);
+    mmu_set_page_dir(task_manager.first_task.mm->page_dir);
     memory_alloc_page_for(first_start, alloc_size, PTE_P | PTE_W | PTE_U);
+    vma_create(&task_manager.first_task.mm->vma_list, first_start, first_start + alloc_size, PTE_P | PTE_W | PTE_U, VMA_ANON);
     kernel_memcpy(s_first_task, (void *)first_start, copy_size);
 
     task_start(&task_manager.first_task);
@@ -213,35 +378,71 @@ task_t * task_first_task(void) {
     return &task_manager.first_task;
 }
 
+static void task_queue_insert(task_t * task) {
+    list_insert_last(&task_manager.ready_list[task->prio], &task->run_node);
+    task_manager.ready_bitmap |= 1 << task->prio;
+    task_manager.ready_count++;
+}
+
+static void task_queue_remove(task_t * task) {
+    list_t * list = &task_manager.ready_list[task->prio];
+    list_remove(list, &task->run_node);
+    if (list_is_empty(list)) {
+        task_manager.ready_bitmap &= ~(1 << task->prio);
+    }
+    task_manager.ready_count--;
+}
+
+// 移到指定优先级队列的末尾，任务须在就绪队列中
+static void task_requeue(task_t * task, int prio) {
+    task_queue_remove(task);
+    task->prio = prio;
+    task_queue_insert(task);
+}
+
 void task_set_ready(task_t * task) {
     if (task == &task_manager.idle_task) {
         return;
     }
-    list_insert_last(&task_manager.ready_list, &task->run_node);
+
+    // 因等待而阻塞的任务被唤醒时提升一级，交互型任务因此保持在较高的优先级
+    if ((task->state == TASK_BLOCKED) || (task->state == TASK_SLEEP) || (task->state == TASK_WAITTING)) {
+        if (task->prio > task->base_prio) {
+            task->prio--;
+        }
+    }
+    task_queue_insert(task);
     task->state = TASK_READY;
+
+    // 从一个可运行任务变为两个时开始按节拍轮转，已设置的中断可能远在一个节拍之后
+    if (task_manager.ready_count == 2) {
+        time_event_before(OS_TICKS_MS * 1000);
+    }
 }
 
 void task_set_block(task_t * task) {
     if (task == &task_manager.idle_task) {
         return;
     }
-    list_remove(&task_manager.ready_list, &task->run_node);
+    task_queue_remove(task);
+    task->state = TASK_BLOCKED;
 }
 
 task_t * task_next_run(void) {
-    if (list_count(&task_manager.ready_list) <= 0) {
+    if (task_manager.ready_bitmap == 0) {
         return &task_manager.idle_task;
     }
-    list_node_t * task_node = list_first(&task_manager.ready_list);
+    int prio = __builtin_ctz(task_manager.ready_bitmap);
+    list_node_t * task_node = list_first(&task_manager.ready_list[prio]);
     return field_2_parent(task_node, task_t, run_node);
 }
 
 int sys_yield(void) {
     irq_state_t state = irq_enter_protection();
-    if (list_count(&task_manager.ready_list) > 1) {
+    if (task_manager.ready_count > 1) {
         task_t * curr_task = task_current();
-        task_set_block(curr_task);
-        task_set_ready(curr_task);
+        task_requeue(curr_task, curr_task->prio);
+        curr_task->state = TASK_READY;
 
         task_dispatch();
     }
@@ -249,12 +450,16 @@ int sys_yield(void) {
     return 0;
 }
 
+/**
+ * 切换到下一个任务，不读写时钟硬件；time_now_ms为上次同步的时间，时间片按节拍计算
+ */
 void task_dispatch(void) {
     task_t * to = task_next_run();
-    if (to != task_current()) {
-        task_t * from = task_current();
+    task_t * from = task_current();
+    if (to != from) {
         task_manager.curr_task = to;
         to->state = TASK_RUNNING;
+        to->slice_end = time_now_ms() + TASK_PRIO_SLICE_MS(to->prio);
         task_switch_from_to(from, to);
     }
 }
@@ -263,133 +468,276 @@ task_t * task_current(void) {
     return task_manager.curr_task;
 }
 
+// 定期把所有任务恢复到原来的优先级，避免低优先级任务长期得不到运行
+static void task_boost_all(void) {
+    list_node_t * node = list_first(&task_manager.task_list);
+    while (node) {
+        task_t * task = field_2_parent(node, task_t, all_node);
+        node = list_node_next(node);
+
+        if ((task == &task_manager.idle_task) || (task->prio == task->base_prio)) {
+            continue;
+        }
+        if ((task->state == TASK_READY) || (task->state == TASK_RUNNING)) {
+            task_requeue(task, task->base_prio);
+        } else {
+            task->prio = task->base_prio;
+        }
+    }
+}
+
 void task_time_tick(void) {
     irq_state_t state = irq_enter_protection();
-    task_t * curr_task = task_current();
-    if (--curr_task->slice_ticks <= 0) {
+    time_sync();
 
-        curr_task->slice_ticks = curr_task->time_ticks;
+    uint32_t now = time_now_ms();
+    if (now - task_manager.boost_time >= TASK_BOOST_MS) {
+        task_manager.boost_time = now;
+        task_boost_all();
+    }
 
-        task_set_block(curr_task);
-        task_set_ready(curr_task);
-    }
-    list_node_t * curr_sleep = list_first(&task_manager.sleep_list);
-    while (curr_sleep) {
-        list_node_t * next = list_node_next(curr_sleep);
-        task_t * task = field_2_parent(curr_sleep, task_t, run_node);
-        if (--task->sleep_ticks <= 0) {
-            task_set_wakeup(task);
-            task_set_ready(task);
-        }
-        curr_sleep = next;
+    // 用完整个时间片的任务降一级，移到新队列的末尾
+    task_t * curr_task = task_current();
+    if ((curr_task != &task_manager.idle_task) && ((int)(now - curr_task->slice_end) >= 0)) {
+        int prio = curr_task->prio < TASK_PRIO_NR - 1 ? curr_task->prio + 1 : curr_task->prio;
+        curr_task->slice_end = now + TASK_PRIO_SLICE_MS(prio);
+        task_requeue(curr_task, prio);
+        curr_task->state = TASK_READY;
     }
+
+    // 单次模式的中断已经用掉，切换任务前设置下一次
+    time_reprogram();
     task_dispatch();
     irq_leave_protection(state);
 }
 
-void task_set_sleep(task_t * task, uint32_t ticks) {
-    if (ticks <= 0) {
+/**
+ * 有多个任务可运行时需要按时间片轮转，只有一个时不需要时钟节拍
+ */
+int task_need_rotate(void) {
+    return task_manager.ready_count > 1;
+}
+
+static void task_sleep_timeout(ktimer_t * timer, void * arg) {
+    task_set_ready((task_t *)arg);
+}
+
+void task_set_sleep(task_t * task, uint32_t us) {
+    if (us <= 0) {
         return;
     }
-    task->sleep_ticks = ticks;
     task->state = TASK_SLEEP;
-    list_insert_last(&task_manager.sleep_list, &task->run_node);
+    timer_add(&task->sleep_timer, us, task_sleep_timeout, task);
 }
 
 
 void task_set_wakeup(task_t * task) {
-    list_remove(&task_manager.sleep_list, &task->run_node);
+    timer_remove(&task->sleep_timer);
 }
 
 
-void sys_sleep(uint32_t ms) {
+static void task_sleep_us(uint32_t us) {
     irq_state_t state = irq_enter_protection();
 
     task_set_block(task_current());
-    task_set_sleep(task_current(), (ms + (OS_TICKS_MS - 1)) / OS_TICKS_MS);
+    task_set_sleep(task_current(), us);
 
     task_dispatch();
 
     irq_leave_protection(state);
 }
 
+/**
+ * 定时器以微秒计，超出32位范围的部分按秒分段睡眠
+ */
+static void task_sleep(uint32_t sec, uint32_t us) {
+    while (sec > 0) {
+        uint32_t n = sec > TASK_SLEEP_MAX_SEC ? TASK_SLEEP_MAX_SEC : sec;
+        task_sleep_us(n * 1000000);
+        sec -= n;
+    }
+    if (us) {
+        task_sleep_us(us);
+    }
+}
+
+void sys_sleep(uint32_t ms) {
+    task_sleep(ms / 1000, (ms % 1000) * 1000);
+}
+
+int sys_nanosleep(const time_spec_t * req, time_spec_t * rem) {
+    if ((req == (time_spec_t *)0) || (memory_check_user((uint32_t)req, sizeof(time_spec_t), 0) < 0)) {
+        return -1;
+    }
+    if (rem && (memory_check_user((uint32_t)rem, sizeof(time_spec_t), 1) < 0)) {
+        return -1;
+    }
+    if (req->nsec >= 1000000000) {
+        return -1;
+    }
+
+    task_sleep(req->sec, (req->nsec + 999) / 1000);
+    if (rem) {
+        rem->sec = rem->nsec = 0;
+    }
+    return 0;
+}
+
 int sys_getpid(void) {
     task_t * curr_task = task_current();
     return curr_task->pid;
 }
 
+static task_t * task_find(int pid) {
+    if (pid == 0) {
+        return task_current();
+    }
+    return task_pid_lookup(pid);
+}
+
+/**
+ * 设置进程的优先级，who为0时表示当前进程，只支持PRIO_PROCESS
+ */
+int sys_setpriority(int which, int who, int prio) {
+    if ((which != PRIO_PROCESS) || (prio < 0) || (prio >= TASK_PRIO_NR)) {
+        return -1;
+    }
+
+    irq_state_t state = irq_enter_protection();
+    task_t * task = task_find(who);
+    if ((task == (task_t *)0) || (task == &task_manager.idle_task)) {
+        irq_leave_protection(state);
+        return -1;
+    }
+
+    task->base_prio = prio;
+    if ((task->state == TASK_READY) || (task->state == TASK_RUNNING)) {
+        task_requeue(task, prio);
+    } else {
+        task->prio = prio;
+    }
+
+    // 可能有更高优先级的任务就绪了
+    task_dispatch();
+    irq_leave_protection(state);
+    return 0;
+}
+
+int sys_getpriority(int which, int who) {
+    if (which != PRIO_PROCESS) {
+        return -1;
+    }
+
+    irq_state_t state = irq_enter_protection();
+    task_t * task = task_find(who);
+    int prio = task ? task->base_prio : -1;
+    irq_leave_protection(state);
+    return prio;
+}
+
 static task_t * alloc_task(void) {
-    task_t * task = (task_t *)0;
-
-    mutex_lock(&task_table_mutex);
-    for (int i = 0; i < TASK_NR; i++) {
-        task_t * curr = task_table + i;
-        if (curr->name[0] == '\0') {
-            task = curr;
-            break;
-        }
+    task_t * task = (task_t *)kmem_cache_alloc(&task_cache);
+    if (task) {
+        kernel_memset(task, 0, sizeof(task_t));
     }
-    mutex_unlock(&task_table_mutex);
     return task;
 }
 
 static void free_task(task_t * task) {
-    mutex_lock(&task_table_mutex);
-    task->name[0] = '\0';
-    mutex_unlock(&task_table_mutex);
+    kmem_cache_free(&task_cache, task);
 }
 
 static void copy_opened_files(task_t * child_task) {
     task_t * parent = task_current();
     for (int i = 0; i < TASK_OFILE_NR; i++) {
-        file_t * file = parent->file_table[i];
+        file_t * file = parent->files->table[i];
         if (file) {
             file_inc_ref(file);
-            child_task->file_table[i] = file;
+            child_task->files->table[i] = file;
         }
     }
 }
 
-int sys_fork(void) {
-    task_t * parent_task = task_current();
+/**
+ * 创建子进程，从父进程系统调用返回处开始运行，返回值为0
+ * 设置TASK_FLAGS_SHARE_VM时与父进程共用地址空间
+ */
+static task_t * task_create_child(task_t * parent_task, int flag) {
     task_t * child_task = alloc_task();
-
     if (child_task == (task_t *)0) {
-        goto fork_failed;
+        return (task_t *)0;
     }
 
-    syscall_frame_t * frame = (syscall_frame_t *)(parent_task->tss.esp0 - sizeof(syscall_frame_t));
-    int err = task_init(child_task, parent_task->name, 0, 
+    syscall_frame_t * frame = (syscall_frame_t *)(parent_task->kernel_stack + MEM_PAGE_SIZE - sizeof(syscall_frame_t));
+    int err = task_init(child_task, parent_task->name, flag, 
                     frame->eip, frame->esp + sizeof(uint32_t) * SYSCALL_PARAM_COUNT);
     
     if (err < 0) {
-        goto fork_failed;
+        free_task(child_task);
+        return (task_t *)0;
     }
 
+    if (flag & TASK_FLAGS_SHARE_VM) {
+        child_task->mm = task_mm_get(parent_task->mm);
+    }
     copy_opened_files(child_task);
 
-    tss_t * tss = &child_task->tss;
-    tss->eax = 0;
-    tss->ebx = frame->ebx;
-    tss->edx = frame->edx;
-    tss->ecx = frame->ecx;
-    tss->esi = frame->esi;
-    tss->edi = frame->edi;
-    tss->ebp = frame->ebp;
-
-    tss->cs = frame->cs;
-    tss->ds = frame->ds;
-    tss->es = frame->es;
-    tss->fs = frame->fs;
-    tss->gs = frame->gs;
-    tss->eflags = frame->eflags;
+    task_frame_t * child_frame = (task_frame_t *)child_task->stack;
+    child_frame->eax = 0;
+    child_frame->ebx = frame->ebx;
+    child_frame->edx = frame->edx;
+    child_frame->ecx = frame->ecx;
+    child_frame->esi = frame->esi;
+    child_frame->edi = frame->edi;
+    child_frame->ebp = frame->ebp;
+
+    child_frame->cs = frame->cs;
+    child_frame->ds = frame->ds;
+    child_frame->es = frame->es;
+    child_frame->fs = frame->fs;
+    child_frame->gs = frame->gs;
+    child_frame->eflags = frame->eflags;
+
+    child_task->base_prio = child_task->prio = parent_task->base_prio;
+    return child_task;
+}
 
+static void task_add_child(task_t * parent_task, task_t * child_task) {
+    irq_state_t state = irq_enter_protection();
     child_task->parent = parent_task;
+    list_insert_last(&parent_task->child_list, &child_task->child_node);
+    irq_leave_protection(state);
+}
+
+int sys_fork(void) {
+    task_t * parent_task = task_current();
+    task_t * child_task = task_create_child(parent_task, 0);
+    if (child_task == (task_t *)0) {
+        goto fork_failed;
+    }
+
+    task_mm_t * mm = child_task->mm;
+    if (vma_copy(&mm->vma_list, &parent_task->mm->vma_list) < 0) {
+        goto fork_failed;
+    }
 
-    if ((tss->cr3 = memory_copy_uvm(parent_task->tss.cr3)) < 0) {
+    uint32_t proc_page;
+    uint32_t page_dir = memory_copy_uvm(parent_task->mm->page_dir, &proc_page);
+    if (page_dir == 0) {
+        goto fork_failed;
+    }
+    memory_destroy_uvm(mm->page_dir);
+    mm->page_dir = page_dir;
+    mm->proc_page = proc_page;
+    memory_vdso_set_pid(proc_page, child_task->pid);
+    mm->heap_start = parent_task->mm->heap_start;
+    mm->heap_end = parent_task->mm->heap_end;
+
+    if (fpu_copy(child_task, parent_task) < 0) {
         goto fork_failed;
     }
 
+    task_add_child(parent_task, child_task);
     task_start(child_task);
 
     return child_task->pid;
@@ -401,33 +749,114 @@ fork_failed:
     return -1;
 }
 
-static int load_phdr(int file, Elf32_Phdr * phdr, uint32_t page_dir) {
-    int err = memory_alloc_for_page_dir(page_dir, phdr->p_vaddr, phdr->p_memsz, PTE_P | PTE_U | PTE_W);
+static void kthread_entry(void) {
+    task_t * task = task_current();
+    sys_exit(task->kthread_fn(task->kthread_arg));
+}
+
+/**
+ * 创建内核线程，在自己的内核栈上运行fn(arg)
+ * fn返回后线程退出，作为first_task的子进程由它回收
+ */
+task_t * kthread_create(char * name, kthread_fn_t fn, void * arg) {
+    task_t * task = alloc_task();
+    if (task == (task_t *)0) {
+        return (task_t *)0;
+    }
+
+    int err = task_init(task, name, TASK_FLAGS_SYSTEM, (uint32_t)kthread_entry, 0);
     if (err < 0) {
-        log_printf("no memory");
+        free_task(task);
+        return (task_t *)0;
+    }
+    task->kthread_fn = fn;
+    task->kthread_arg = arg;
+
+    task_add_child(&task_manager.first_task, task);
+    task_start(task);
+    return task;
+}
+
+/**
+ * vfork的子进程不再使用父进程的地址空间，唤醒父进程
+ */
+static void task_vfork_release(task_t * task) {
+    irq_state_t state = irq_enter_protection();
+    task_t * parent = task->vfork_parent;
+    if (parent) {
+        task->vfork_parent = (task_t *)0;
+        memory_vdso_set_pid(parent->mm->proc_page, parent->pid);
+        task_set_ready(parent);
+    }
+    irq_leave_protection(state);
+}
+
+/**
+ * 子进程直接使用父进程的地址空间，不做复制
+ * 父进程一直等到子进程execve或退出才返回，期间子进程会使用父进程的栈
+ */
+int sys_vfork(void) {
+    task_t * parent_task = task_current();
+    task_t * child_task = task_create_child(parent_task, TASK_FLAGS_SHARE_VM);
+    if (child_task == (task_t *)0) {
         return -1;
     }
-    if (sys_lseek(file, phdr->p_offset, 0) < 0) {
-        log_printf("read file failed.");
+    child_task->vfork_parent = parent_task;
+
+    // 子进程使用期间进程页中为子进程的pid，release时改回
+    memory_vdso_set_pid(parent_task->mm->proc_page, child_task->pid);
+
+    int pid = child_task->pid;
+    irq_state_t state = irq_enter_protection();
+    task_add_child(parent_task, child_task);
+    task_start(child_task);
+    while (child_task->vfork_parent) {
+        task_set_block(parent_task);
+        task_dispatch();
+    }
+    irq_leave_protection(state);
+    return pid;
+}
+
+/**
+ * 创建线程，与调用者共用地址空间和打开的文件，在esp指定的用户栈上从entry开始运行
+ * 栈上的参数及返回地址由调用者准备好
+ */
+int sys_clone(uint32_t entry, uint32_t esp) {
+    task_t * parent_task = task_current();
+    task_t * child_task = alloc_task();
+    if (child_task == (task_t *)0) {
         return -1;
     }
-    uint32_t vaddr = phdr->p_vaddr;
-    uint32_t size = phdr->p_filesz;
-    while (size > 0) {
-        int curr_size = size > MEM_PAGE_SIZE ? MEM_PAGE_SIZE : size;
-        uint32_t paddr = memory_get_paddr(page_dir, vaddr);
-        if (sys_read(file, (char *)paddr, curr_size) < curr_size) {
-            log_printf("read file failed.");
-            return -1;
-        }
-        size -= curr_size;
-        vaddr += curr_size;
+
+    int err = task_init(child_task, parent_task->name, TASK_FLAGS_SHARE_VM, entry, esp);
+    if (err < 0) {
+        free_task(child_task);
+        return -1;
     }
+    child_task->mm = task_mm_get(parent_task->mm);
+    task_files_put(child_task->files);
+    child_task->files = task_files_get(parent_task->files);
+
+    child_task->base_prio = child_task->prio = parent_task->base_prio;
+    task_add_child(parent_task, child_task);
+    task_start(child_task);
+    return child_task->pid;
+}
+
+static int load_phdr(file_t * file, Elf32_Phdr * phdr, list_t * vma_list) {
+    // 只记录段的位置，页面内容在缺页时再从文件中读取
+    vma_t * vma = vma_create(vma_list, phdr->p_vaddr, phdr->p_vaddr + phdr->p_memsz, PTE_P | PTE_U | PTE_W, VMA_FILE);
+    if (vma == (vma_t *)0) {
+        log_printf("no memory");
+        return -1;
+    }
+    vma_set_file(vma, file, phdr->p_offset, phdr->p_filesz);
     return 0;
 }
 
 
-static uint32_t load_elf_file(task_t * task, char * name, uint32_t page_dir) {
+static uint32_t load_elf_file(task_mm_t * mm, char * name) {
     Elf32_Ehdr elf_hdr;
     Elf32_Phdr elf_phdr;
 
@@ -436,7 +865,8 @@ static uint32_t load_elf_file(task_t * task, char * name, uint32_t page_dir) {
         log_printf("open failed. %s", name);
         goto load_failed;
     }
-    int cnt = sys_read(file, (char *)&elf_hdr, sizeof(elf_hdr));
+    // 头部读到内核栈上，不经过检查用户缓冲区的sys_read
+    int cnt = fs_read_file(task_file(file), 0, (char *)&elf_hdr, sizeof(elf_hdr));
     if (cnt < sizeof(Elf32_Ehdr)) {
         log_printf("elf hdr too small. size=%d", cnt);
         goto load_failed;
@@ -451,11 +881,7 @@ static uint32_t load_elf_file(task_t * task, char * name, uint32_t page_dir) {
 
     uint32_t e_phoff = elf_hdr.e_phoff;
     for (int i = 0; i < elf_hdr.e_phnum; i++, e_phoff += elf_hdr.e_phentsize) {
-        if (sys_lseek(file, e_phoff, 0) < 0) {
-            log_printf("read file failed.");
-            goto load_failed;
-        }
-        cnt = sys_read(file, (char *)&elf_phdr, sizeof(elf_phdr));
+        cnt = fs_read_file(task_file(file), e_phoff, (char *)&elf_phdr, sizeof(elf_phdr));
         if (cnt < sizeof(elf_phdr)) {
             log_printf("read file failed.");
             goto load_failed;
@@ -463,19 +889,23 @@ static uint32_t load_elf_file(task_t * task, char * name, uint32_t page_dir) {
         if ((elf_phdr.p_type != 1) || (elf_phdr.p_vaddr < MEM_TASK_BASE) ) {
             continue;
         }
-        int err = load_phdr(file, &elf_phdr, page_dir);
+        int err = load_phdr(task_file(file), &elf_phdr, &mm->vma_list);
         if (err < 0) {
             log_printf("load pragram failed.");
             goto load_failed;
         }
-        task->heap_start = elf_phdr.p_vaddr + elf_phdr.p_memsz;
-        task->heap_end = task->heap_start;
+        mm->heap_start = elf_phdr.p_vaddr + elf_phdr.p_memsz;
+        mm->heap_end = mm->heap_start;
+    }
+
+    if (vma_create(&mm->vma_list, mm->heap_start, mm->heap_end, PTE_P | PTE_U | PTE_W, VMA_ANON | VMA_HEAP) == (vma_t *)0) {
+        goto load_failed;
     }
 
     sys_close(file);
     return elf_hdr.e_entry;
 load_failed:
-    if (file) {
+    if (file >= 0) {
         sys_close(file);
     }
     return 0;
@@ -505,124 +935,221 @@ static int copy_args(char * to, uint32_t page_dir, int argc, char ** argv) {
     return memory_copy_uvm_data((uint32_t)to, page_dir, (uint32_t)&task_args, sizeof(task_args_t));
 }
 
-int sys_execve(char * name, char ** argv, char ** env) {
-    task_t * task = task_current();
-
-    kernel_strncpy(get_file_name(name), task->name, TASK_NAME_SIZE);
-
-    uint32_t old_page_dir = task->tss.cr3;
-    uint32_t new_page_dir = memory_create_uvm();
-    if (!new_page_dir) {
-        goto exec_failed;
-    }
-
-    uint32_t entry = load_elf_file(task, name, new_page_dir);
+/**
+ * 在mm中建立程序的各个区域及栈，参数复制到栈顶，返回入口地址
+ */
+static uint32_t load_task_image(task_mm_t * mm, char * name, char ** argv) {
+    uint32_t entry = load_elf_file(mm, name);
     if (entry == 0) {
-        goto exec_failed;
+        return 0;
     }
 
+    // 整个栈区域按需分配，只有存放参数的顶部需要立即分配
     uint32_t stack_top = MEM_TASK_STACK_TOP - MEM_TASK_ARG_SIZE;
-    int err = memory_alloc_for_page_dir(new_page_dir, 
+    vma_t * stack = vma_create(&mm->vma_list, 
             MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE, 
-            MEM_TASK_STACK_SIZE, 
-            PTE_P | PTE_U | PTE_W
+            MEM_TASK_STACK_TOP, 
+            PTE_P | PTE_U | PTE_W, 
+            VMA_ANON | VMA_STACK
     );
+    if (stack == (vma_t *)0) {
+        return 0;
+    }
+    int err = memory_alloc_for_page_dir(mm->page_dir, stack_top, MEM_TASK_ARG_SIZE, PTE_P | PTE_U | PTE_W);
     if (err < 0) {
-        goto exec_failed;
+        return 0;
     }
 
     int argc = strings_count(argv);
-    err = copy_args((char *)stack_top, new_page_dir, argc, argv);
+    err = copy_args((char *)stack_top, mm->page_dir, argc, argv);
     if (err < 0) {
+        return 0;
+    }
+    return entry;
+}
+
+int sys_execve(char * name, char ** argv, char ** env) {
+    task_t * task = task_current();
+
+    kernel_strncpy(get_file_name(name), task->name, TASK_NAME_SIZE);
+
+    task_mm_t * new_mm = task_mm_create();
+    if (new_mm == (task_mm_t *)0) {
+        goto exec_failed;
+    }
+
+    uint32_t entry = load_task_image(new_mm, name, argv);
+    if (entry == 0) {
         goto exec_failed;
     }
 
-    syscall_frame_t * frame = (syscall_frame_t *)(task->tss.esp0 - sizeof(syscall_frame_t));
+    syscall_frame_t * frame = (syscall_frame_t *)(task->kernel_stack + MEM_PAGE_SIZE - sizeof(syscall_frame_t));
     frame->eip = entry;
-    frame->esp = stack_top - sizeof(uint32_t) * SYSCALL_PARAM_COUNT;
+    frame->esp = MEM_TASK_STACK_TOP - MEM_TASK_ARG_SIZE - sizeof(uint32_t) * SYSCALL_PARAM_COUNT;
     frame->eax = frame->ebx = frame->ecx = frame->edx = 0;
     frame->esi = frame->edi = frame->ebp = 0;
     frame->eflags = EFLAGS_IF | EFLAGS_DEFAULT;
 
-    task->tss.cr3 = new_page_dir;
-    mmu_set_page_dir(new_page_dir);
-    memory_destroy_uvm(old_page_dir);
-
+    // 原地址空间可能还被线程或vfork的父进程使用，由引用计数决定是否释放
+    task_mm_t * old_mm = task->mm;
+    task->mm = new_mm;
+    mmu_set_page_dir(new_mm->page_dir);
+    memory_vdso_set_pid(new_mm->proc_page, task->pid);
+    task_mm_put(old_mm);
+    task_vfork_release(task);
+
+    // 新程序从初始的FPU状态开始，原地址空间中登记的环也不再有效
+    fpu_release(task);
+    task->ring = (struct _sysring_t *)0;
     return 0;
 exec_failed:
-    if (new_page_dir) {
-        task->tss.cr3 = old_page_dir;
-        mmu_set_page_dir(old_page_dir);
-        memory_destroy_uvm(new_page_dir);
+    if (new_mm) {
+        task_mm_put(new_mm);
     }
     return -1;
 }
 
-void sys_exit(int status) {
-    task_t * curr_task = task_current();
+/**
+ * 由程序文件直接创建子进程，不复制父进程的地址空间
+ * fd_map为空时继承父进程所有打开的文件，否则只把fd_map中的文件依次作为子进程的0~2
+ * 内核没有环境变量，不像execve那样保留一个不使用的env参数
+ */
+int sys_spawn(char * name, char ** argv, int * fd_map) {
+    task_t * parent_task = task_current();
+    task_t * child_task = alloc_task();
+    if (child_task == (task_t *)0) {
+        return -1;
+    }
 
-    for (int fd = 0; fd < TASK_OFILE_NR; fd++) {
-        file_t * p_file = curr_task->file_table[fd];
-        if (p_file) {
-            sys_close(fd);
-            curr_task->file_table[fd] = (file_t *)0;
-        }
+    uint32_t stack_top = MEM_TASK_STACK_TOP - MEM_TASK_ARG_SIZE;
+    int err = task_init(child_task, get_file_name(name), 0, 0, stack_top);
+    if (err < 0) {
+        free_task(child_task);
+        return -1;
+    }
+
+    uint32_t entry = load_task_image(child_task->mm, name, argv);
+    if (entry == 0) {
+        task_uninit(child_task);
+        free_task(child_task);
+        return -1;
     }
+    task_frame_t * child_frame = (task_frame_t *)child_task->stack;
+    child_frame->eip = entry;
 
-    int move_child = 0;
-    mutex_lock(&task_table_mutex);
-    for (int i = 0; i < TASK_NR; i++) {
-        task_t * task = task_table + i;
-        if (task->parent == curr_task) {
-            task->parent = &task_manager.first_task;
-            if (task->state == TASK_ZOMBIE) {
-                move_child = 1;
+    if (fd_map == (int *)0) {
+        copy_opened_files(child_task);
+    } else {
+        for (int i = 0; i < TASK_SPAWN_FD_NR; i++) {
+            file_t * file = (fd_map[i] >= 0) ? task_file(fd_map[i]) : (file_t *)0;
+            if (file) {
+                file_inc_ref(file);
+                child_task->files->table[i] = file;
             }
         }
     }
-    mutex_unlock(&task_table_mutex);
+
+    child_task->base_prio = child_task->prio = parent_task->base_prio;
+    task_add_child(parent_task, child_task);
+    task_start(child_task);
+    return child_task->pid;
+}
+
+void sys_exit(int status) {
+    task_t * curr_task = task_current();
+
+    // 文件表的最后一个使用者关闭所有文件
+    task_files_put(curr_task->files);
+    curr_task->files = (task_files_t *)0;
+    fpu_release(curr_task);
+
+    // 没有其它线程时尽早写回共享文件映射，其余部分在回收时释放
+    if (curr_task->mm && (curr_task->mm->ref == 1)) {
+        memory_munmap_all(curr_task->mm->page_dir, &curr_task->mm->vma_list);
+    }
 
     irq_state_t state = irq_enter_protection();
-    task_t * parent = curr_task->parent;
-    if (move_child && parent != &task_manager.first_task) {
-        if (task_manager.first_task.state == TASK_WAITTING) {
-            task_set_ready(&task_manager.first_task);
-        }
+
+    // 子进程都交给first_task，有已退出的子进程时唤醒它来回收
+    task_t * init_task = &task_manager.first_task;
+    int move_zombie = !list_is_empty(&curr_task->zombie_list);
+    list_node_t * node;
+    while ((node = list_remove_first(&curr_task->child_list)) != (list_node_t *)0) {
+        task_t * child = field_2_parent(node, task_t, child_node);
+        child->parent = init_task;
+        list_insert_last(&init_task->child_list, node);
+    }
+    while ((node = list_remove_first(&curr_task->zombie_list)) != (list_node_t *)0) {
+        task_t * child = field_2_parent(node, task_t, child_node);
+        child->parent = init_task;
+        list_insert_last(&init_task->zombie_list, node);
+    }
+    if (move_zombie && (init_task->state == TASK_WAITTING)) {
+        task_set_ready(init_task);
     }
+
+    // 移到父进程的僵尸链表中，由父进程回收
+    task_t * parent = curr_task->parent;
+    list_remove(&parent->child_list, &curr_task->child_node);
+    list_insert_last(&parent->zombie_list, &curr_task->child_node);
     if (parent->state == TASK_WAITTING) {
         task_set_ready(parent);
     }
+    task_vfork_release(curr_task);
     curr_task->status = status;
-    curr_task->state = TASK_ZOMBIE;
     task_set_block(curr_task);
+    curr_task->state = TASK_ZOMBIE;
     task_dispatch();
     irq_leave_protection(state);
 }
 
-int sys_wait(int * status) {
+static int task_is_child(task_t * parent, int pid) {
+    task_t * task = task_pid_lookup(pid);
+    return task && (task->parent == parent) && (task->state != TASK_ZOMBIE);
+}
+
+/**
+ * 等待子进程退出，pid为-1时等待任意子进程
+ * 设置WAIT_NOHANG时没有已退出的子进程立即返回0，没有可等待的子进程时返回-1
+ */
+int sys_waitpid(int pid, int * status, int options) {
     task_t * curr_task = task_current();
 
+    // 回收子进程之后再出错，它的退出状态就丢了，因此先检查
+    if (status && (memory_check_user((uint32_t)status, sizeof(int), 1) < 0)) {
+        return -1;
+    }
+
     for (;;) {
-        mutex_lock(&task_table_mutex);
-        for (int i = 0; i < TASK_NR; i++) {
-            task_t * task = task_table + i;
-            if (task->parent != curr_task) {
+        irq_state_t state = irq_enter_protection();
+        list_node_t * node = list_first(&curr_task->zombie_list);
+        while (node) {
+            task_t * task = field_2_parent(node, task_t, child_node);
+            if ((pid > 0) && (task->pid != pid)) {
+                node = list_node_next(node);
                 continue;
             }
-            if (task->state == TASK_ZOMBIE) {
-                int pid = task->pid;
-                *status = task->status;
 
-                memory_destroy_uvm(task->tss.cr3);
-                memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
-                kernel_memset(task, 0, sizeof(task_t));
+            list_remove(&curr_task->zombie_list, node);
+            int child_pid = task->pid;
+            int exit_status = task->status;
+            irq_leave_protection(state);
+
+            task_uninit(task);
+            free_task(task);
 
-                mutex_unlock(&task_table_mutex);
-                return pid;
+            if (status) {
+                *status = exit_status;
             }
+            return child_pid;
         }
-        mutex_unlock(&task_table_mutex);
-        irq_state_t state = irq_enter_protection();
+
+        int has_child = (pid > 0) ? task_is_child(curr_task, pid) : !list_is_empty(&curr_task->child_list);
+        if (!has_child || (options & WAIT_NOHANG)) {
+            irq_leave_protection(state);
+            return has_child ? 0 : -1;
+        }
+
         task_set_block(curr_task);
         curr_task->state = TASK_WAITTING;
         task_dispatch();
@@ -630,3 +1157,7 @@ int sys_wait(int * status) {
     }
     return 0;
 }
+
+int sys_wait(int * status) {
+    return sys_waitpid(-1, status, 0);
+}
@@ -0,0 +1,115 @@
+#include "core/timer.h"
+#include "cpu/irq.h"
+#include "dev/time.h"
+#include "tools/list.h"
+
+
+static list_t timer_list;
+
+void timer_init(void) {
+    list_init(&timer_list);
+}
+
+/**
+ * 添加定时器，us微秒后到期
+ */
+void timer_add(ktimer_t * timer, uint32_t us, timer_proc_t proc, void * arg) {
+    if (us == 0) {
+        us = 1;
+    }
+
+    irq_state_t state = irq_enter_protection();
+
+    // 先把已经过去的时间计入链表，新定时器从现在开始计时
+    time_sync();
+
+    timer->proc = proc;
+    timer->arg = arg;
+    timer->active = 1;
+
+    // 找到插入位置，沿途扣除前面定时器的时间差
+    list_node_t * node = list_first(&timer_list);
+    while (node) {
+        ktimer_t * curr = field_2_parent(node, ktimer_t, node);
+        if (us < curr->delta) {
+            curr->delta -= us;
+            break;
+        }
+        us -= curr->delta;
+        node = list_node_next(node);
+    }
+    timer->delta = us;
+    list_insert_before(&timer_list, node, &timer->node);
+
+    // 成为最早到期的定时器时，原来设置的下次中断可能太晚
+    if (list_first(&timer_list) == &timer->node) {
+        time_event_before(timer->delta);
+    }
+    irq_leave_protection(state);
+}
+
+void timer_remove(ktimer_t * timer) {
+    irq_state_t state = irq_enter_protection();
+    if (timer->active) {
+        // 剩余的时间差交给后一个定时器
+        int first = list_first(&timer_list) == &timer->node;
+        list_node_t * next = list_node_next(&timer->node);
+        if (next) {
+            ktimer_t * next_timer = field_2_parent(next, ktimer_t, node);
+            next_timer->delta += timer->delta;
+        }
+        list_remove(&timer_list, &timer->node);
+        timer->active = 0;
+
+        // 最早的到期时间推后了，按新的到期时间设置，省去一次提前的中断
+        if (first) {
+            time_sync();
+            time_reprogram();
+        }
+    }
+    irq_leave_protection(state);
+}
+
+/**
+ * 时间前进us微秒，处理到期的定时器
+ */
+void timer_advance(uint32_t us) {
+    irq_state_t state = irq_enter_protection();
+    list_node_t * node = list_first(&timer_list);
+    while (node && us) {
+        ktimer_t * timer = field_2_parent(node, ktimer_t, node);
+        if (timer->delta > us) {
+            timer->delta -= us;
+            break;
+        }
+        us -= timer->delta;
+        timer->delta = 0;
+        node = list_node_next(node);
+    }
+
+    while ((node = list_first(&timer_list)) != (list_node_t *)0) {
+        ktimer_t * timer = field_2_parent(node, ktimer_t, node);
+        if (timer->delta > 0) {
+            break;
+        }
+        list_remove_first(&timer_list);
+        timer->active = 0;
+        timer->proc(timer, timer->arg);
+    }
+    irq_leave_protection(state);
+}
+
+/**
+ * 距离最近一个定时器到期的时间，没有定时器时返回TIME_NO_EVENT
+ */
+uint32_t timer_next_us(void) {
+    irq_state_t state = irq_enter_protection();
+    list_node_t * node = list_first(&timer_list);
+    uint32_t us = TIME_NO_EVENT;
+    if (node) {
+        ktimer_t * timer = field_2_parent(node, ktimer_t, node);
+        us = timer->delta;
+    }
+    irq_leave_protection(state);
+    return us;
+}
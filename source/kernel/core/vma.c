@@ -0,0 +1,169 @@
+#include "core/vma.h"
+#include "core/slab.h"
+#include "fs/file.h"
+#include "fs/fs.h"
+#include "ipc/shm.h"
+#include "tools/klib.h"
+#include "tools/list.h"
+#include "tools/log.h"
+
+
+static kmem_cache_t vma_cache;
+
+void vma_init(void) {
+    kmem_cache_init(&vma_cache, "vma", sizeof(vma_t));
+}
+
+static vma_t * vma_alloc(void) {
+    vma_t * vma = (vma_t *)kmem_cache_alloc(&vma_cache);
+    if (vma == (vma_t *)0) {
+        log_printf("no free vma");
+        return (vma_t *)0;
+    }
+    kernel_memset(vma, 0, sizeof(vma_t));
+    return vma;
+}
+
+static void vma_free(vma_t * vma) {
+    if (vma->file) {
+        fs_close_file(vma->file);
+        vma->file = (file_t *)0;
+    }
+    if (vma->shm) {
+        shm_put(vma->shm);
+        vma->shm = (struct _shm_t *)0;
+    }
+
+    kmem_cache_free(&vma_cache, vma);
+}
+
+vma_t * vma_create(list_t * vma_list, uint32_t start, uint32_t end, uint32_t perm, int flags) {
+    vma_t * vma = vma_alloc();
+    if (vma == (vma_t *)0) {
+        return (vma_t *)0;
+    }
+    vma->start = start;
+    vma->end = end;
+    vma->perm = perm;
+    vma->flags = flags;
+    list_insert_last(vma_list, &vma->node);
+    return vma;
+}
+
+void vma_set_file(vma_t * vma, file_t * file, uint32_t offset, uint32_t size) {
+    file_inc_ref(file);
+    vma->file = file;
+    vma->file_offset = offset;
+    vma->file_size = size;
+}
+
+/**
+ * 从addr处把区域拆成两段，返回新建的后一段，原区域只保留前一段
+ * 后一段对应的文件或共享内存段的位置随之后移
+ */
+vma_t * vma_split(list_t * vma_list, vma_t * vma, uint32_t addr) {
+    vma_t * tail = vma_create(vma_list, addr, vma->end, vma->perm, vma->flags);
+    if (tail == (vma_t *)0) {
+        return (vma_t *)0;
+    }
+
+    uint32_t delta = addr - vma->start;
+    if (vma->file) {
+        uint32_t size = vma->file_size > delta ? vma->file_size - delta : 0;
+        vma_set_file(tail, vma->file, vma->file_offset + delta, size);
+        if (vma->file_size > delta) {
+            vma->file_size = delta;
+        }
+    } else {
+        tail->file_offset = vma->file_offset + delta;
+    }
+    if (vma->shm) {
+        shm_get(vma->shm);
+        tail->shm = vma->shm;
+    }
+
+    vma->end = addr;
+    return tail;
+}
+
+vma_t * vma_find(list_t * vma_list, uint32_t vaddr) {
+    list_node_t * node = list_first(vma_list);
+    while (node) {
+        vma_t * vma = field_2_parent(node, vma_t, node);
+        if ((vaddr >= vma->start) && (vaddr < vma->end)) {
+            return vma;
+        }
+        node = list_node_next(node);
+    }
+    return (vma_t *)0;
+}
+
+vma_t * vma_find_flags(list_t * vma_list, int flags) {
+    list_node_t * node = list_first(vma_list);
+    while (node) {
+        vma_t * vma = field_2_parent(node, vma_t, node);
+        if ((vma->flags & flags) == flags) {
+            return vma;
+        }
+        node = list_node_next(node);
+    }
+    return (vma_t *)0;
+}
+
+/**
+ * 在[start, end)中查找一段未被占用的、大小为size的区域，找不到返回0
+ */
+uint32_t vma_find_free(list_t * vma_list, uint32_t start, uint32_t end, uint32_t size) {
+    uint32_t addr = start;
+    while ((addr < end) && (end - addr >= size)) {
+        vma_t * conflict = (vma_t *)0;
+        list_node_t * node = list_first(vma_list);
+        while (node) {
+            vma_t * vma = field_2_parent(node, vma_t, node);
+            if ((vma->start < addr + size) && (vma->end > addr)) {
+                conflict = vma;
+                break;
+            }
+            node = list_node_next(node);
+        }
+
+        if (conflict == (vma_t *)0) {
+            return addr;
+        }
+        addr = conflict->end;
+    }
+    return 0;
+}
+
+int vma_copy(list_t * to, list_t * from) {
+    list_node_t * node = list_first(from);
+    while (node) {
+        vma_t * vma = field_2_parent(node, vma_t, node);
+        vma_t * copy = vma_create(to, vma->start, vma->end, vma->perm, vma->flags);
+        if (copy == (vma_t *)0) {
+            vma_destroy_all(to);
+            return -1;
+        }
+        if (vma->file) {
+            vma_set_file(copy, vma->file, vma->file_offset, vma->file_size);
+        }
+        if (vma->shm) {
+            shm_get(vma->shm);
+            copy->shm = vma->shm;
+        }
+        node = list_node_next(node);
+    }
+    return 0;
+}
+
+void vma_destroy(list_t * vma_list, vma_t * vma) {
+    list_remove(vma_list, &vma->node);
+    vma_free(vma);
+}
+
+void vma_destroy_all(list_t * vma_list) {
+    list_node_t * node;
+    while ((node = list_remove_first(vma_list)) != (list_node_t *)0) {
+        vma_free(field_2_parent(node, vma_t, node));
+    }
+}
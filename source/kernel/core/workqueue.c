@@ -0,0 +1,80 @@
+#include "core/workqueue.h"
+#include "core/task.h"
+#include "cpu/irq.h"
+#include "tools/list.h"
+#include "tools/log.h"
+
+
+static workqueue_t system_wq;
+
+void work_init(work_t * work, work_fn_t fn) {
+    list_node_init(&work->node);
+    work->fn = fn;
+    work->pending = 0;
+}
+
+static int workqueue_thread(void * arg) {
+    workqueue_t * wq = (workqueue_t *)arg;
+
+    for (;;) {
+        irq_state_t state = irq_enter_protection();
+        list_node_t * node;
+        while ((node = list_remove_first(&wq->work_list)) == (list_node_t *)0) {
+            wq->idle = 1;
+            task_set_block(task_current());
+            task_dispatch();
+        }
+        work_t * work = field_2_parent(node, work_t, node);
+        work->pending = 0;
+        irq_leave_protection(state);
+
+        work->fn(work);
+    }
+    return 0;
+}
+
+int workqueue_init(workqueue_t * wq, char * name) {
+    list_init(&wq->work_list);
+    wq->idle = 0;
+    wq->worker = kthread_create(name, workqueue_thread, wq);
+    if (wq->worker == (task_t *)0) {
+        log_printf("create worker %s failed.", name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 加入队列，只唤醒工作线程，不立即切换，可在中断中调用
+ * 工作已在队列中时返回0
+ */
+int workqueue_add(workqueue_t * wq, work_t * work) {
+    irq_state_t state = irq_enter_protection();
+    if (work->pending) {
+        irq_leave_protection(state);
+        return 0;
+    }
+
+    work->pending = 1;
+    list_insert_last(&wq->work_list, &work->node);
+    if (wq->idle) {
+        wq->idle = 0;
+        task_set_ready(wq->worker);
+    }
+    irq_leave_protection(state);
+    return 1;
+}
+
+void workqueue_system_init(void) {
+    workqueue_init(&system_wq, "kworker");
+}
+
+/**
+ * 加入系统工作队列，队列还未创建时返回-1，由调用者自己完成
+ */
+int work_schedule(work_t * work) {
+    if (system_wq.worker == (task_t *)0) {
+        return -1;
+    }
+    return workqueue_add(&system_wq, work);
+}
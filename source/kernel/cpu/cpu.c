@@ -35,6 +35,12 @@ void gdt_init(void) {
     segment_desc_set(KERNEL_SELECTOR_DS, 0, 0xFFFFFFFF, 
         SEG_P_PRESENT | SEG_DPL0 | SEG_S_NORMAL | SEG_TYPE_DATA | SEG_TYPE_RW | SEG_D
     );
+    segment_desc_set(APP_SELECTOR_CS, 0, 0xFFFFFFFF,
+        SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_CODE | SEG_TYPE_RW | SEG_D
+    );
+    segment_desc_set(APP_SELECTOR_DS, 0, 0xFFFFFFFF,
+        SEG_P_PRESENT | SEG_DPL3 | SEG_S_NORMAL | SEG_TYPE_DATA | SEG_TYPE_RW | SEG_D
+    );
 
     gate_desc_set((gate_desc_t *)(gdt_table + (SELECTOR_SYSCALL >> 3)), 
         KERNEL_SELECTOR_CS, (uint32_t)exception_handler_syscall, 
@@ -72,11 +78,23 @@ void gdt_free_desc(int sel) {
 }
 
 
+/**
+ * 设置SYSENTER进入内核时的栈
+ * SYSENTER使用固定的栈地址，这里指向tss，入口处再从中取出当前任务的esp0
+ */
+void cpu_sysenter_set_stack(tss_t * tss) {
+    if (cpu_has_sysenter()) {
+        write_msr(MSR_SYSENTER_ESP, (uint32_t)tss);
+    }
+}
+
 void cpu_init(void) {
     mutex_init(&mutex);
     gdt_init();
-}
 
-void switch_to_tss(int tss_sel) {
-    far_jmp(tss_sel, 0);
-}
\ No newline at end of file
+    // 快速系统调用入口，调用门仍然保留
+    if (cpu_has_sysenter()) {
+        write_msr(MSR_SYSENTER_CS, KERNEL_SELECTOR_CS);
+        write_msr(MSR_SYSENTER_EIP, (uint32_t)exception_handler_sysenter);
+    }
+}
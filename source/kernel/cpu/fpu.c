@@ -0,0 +1,131 @@
+/**
+ * FPU/SSE状态的延迟切换
+ *
+ * 切换任务时不保存FPU寄存器，只置位CR0.TS。任务首次使用FPU时触发#NM，
+ * 此时才保存上一个使用者的状态并加载当前任务的状态，不使用FPU的任务没有额外开销
+ */
+#include "cpu/fpu.h"
+#include "comm/cpu_instr.h"
+#include "core/slab.h"
+#include "core/task.h"
+#include "cpu/irq.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static kmem_cache_t fpu_cache;
+static int fpu_present;
+static task_t * fpu_owner;              // FPU寄存器中是哪个任务的状态
+static fpu_state_t fpu_init_state __attribute__((aligned(16)));    // 初始化后的状态，首次使用时加载
+
+void fpu_init(void) {
+    kmem_cache_init(&fpu_cache, "fpu", sizeof(fpu_state_t));
+    fpu_owner = (task_t *)0;
+    fpu_present = 0;
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if ((edx & CPUID_FEAT_EDX_FXSR) == 0) {
+        // 无法保存完整状态，禁止用户使用FPU
+        write_cr0(read_cr0() | CR0_EM);
+        log_printf("no fxsave support, fpu disabled");
+        return;
+    }
+
+    uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+    if (edx & CPUID_FEAT_EDX_SSE) {
+        cr4 |= CR4_OSXMMEXCPT;
+    }
+    write_cr4(cr4);
+
+    // 浮点错误通过#MF报告，而不是外部中断
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+    fninit();
+    fxsave(&fpu_init_state);
+    write_cr0(read_cr0() | CR0_TS);
+    fpu_present = 1;
+}
+
+/**
+ * 切换到新任务前调用，FPU中不是它的状态时置位TS
+ */
+void fpu_switch(task_t * to) {
+    if (!fpu_present) {
+        return;
+    }
+
+    uint32_t cr0 = read_cr0();
+    if (to == fpu_owner) {
+        if (cr0 & CR0_TS) {
+            clts();
+        }
+    } else if ((cr0 & CR0_TS) == 0) {
+        write_cr0(cr0 | CR0_TS);
+    }
+}
+
+/**
+ * #NM异常的处理，保存原使用者的状态，加载当前任务的状态
+ */
+int fpu_handle_unavailable(void) {
+    task_t * curr = task_current();
+    if (!fpu_present || (curr == (task_t *)0)) {
+        return -1;
+    }
+
+    if (curr->fpu == (fpu_state_t *)0) {
+        curr->fpu = (fpu_state_t *)kmem_cache_alloc(&fpu_cache);
+        if (curr->fpu == (fpu_state_t *)0) {
+            log_printf("alloc fpu state failed");
+            return -1;
+        }
+        kernel_memcpy(&fpu_init_state, curr->fpu, sizeof(fpu_state_t));
+    }
+
+    clts();
+    if (fpu_owner != curr) {
+        if (fpu_owner) {
+            fxsave(fpu_owner->fpu);
+        }
+        fxrstor(curr->fpu);
+        fpu_owner = curr;
+    }
+    return 0;
+}
+
+/**
+ * fork时复制父进程的FPU状态，没有用过FPU的不需要复制
+ */
+int fpu_copy(task_t * to, task_t * from) {
+    if (from->fpu == (fpu_state_t *)0) {
+        return 0;
+    }
+
+    to->fpu = (fpu_state_t *)kmem_cache_alloc(&fpu_cache);
+    if (to->fpu == (fpu_state_t *)0) {
+        return -1;
+    }
+
+    // 最新的状态还在寄存器中，from正在运行，TS已清除
+    irq_state_t state = irq_enter_protection();
+    if (fpu_owner == from) {
+        fxsave(from->fpu);
+    }
+    kernel_memcpy(from->fpu, to->fpu, sizeof(fpu_state_t));
+    irq_leave_protection(state);
+    return 0;
+}
+
+/**
+ * 任务退出或加载新程序时丢弃FPU状态，再次使用时从初始状态开始
+ */
+void fpu_release(task_t * task) {
+    if (fpu_owner == task) {
+        fpu_owner = (task_t *)0;
+        write_cr0(read_cr0() | CR0_TS);
+    }
+
+    if (task->fpu) {
+        kmem_cache_free(&fpu_cache, task->fpu);
+        task->fpu = (fpu_state_t *)0;
+    }
+}
@@ -1,9 +1,11 @@
 #include "comm/cpu_instr.h"
 #include "comm/types.h"
+#include "core/memory.h"
 #include "core/syscall.h"
 #include "core/task.h"
 #include "cpu/irq.h"
 #include "cpu/cpu.h"
+#include "cpu/fpu.h"
 #include "os_cfg.h"
 #include "tools/log.h"
 
@@ -92,6 +94,10 @@ void do_handler_invalid_opcode(exception_frame_t * frame) {
 }
 
 void do_handler_device_unavabliable(exception_frame_t * frame) {
+    // 延迟切换FPU状态，加载失败时才按异常处理
+    if (fpu_handle_unavailable() == 0) {
+        return;
+    }
     do_default_handler(frame, "device_unavabliable exception");
 }
 
@@ -140,6 +146,10 @@ void do_handler_general_protection(exception_frame_t * frame) {
 }
 
 void do_handler_page_fault(exception_frame_t * frame) {
+    if (memory_handle_page_fault(read_cr2(), frame->err_code) == 0) {
+        return;
+    }
+
     log_printf("-------------------");
     log_printf("Page fault.");
 
@@ -162,7 +172,9 @@ void do_handler_page_fault(exception_frame_t * frame) {
     }
 
     dump_core_regs(frame);
-    if (frame->cs & 0x3) {
+
+    // 系统调用中访问了非法的用户地址时只结束该进程，不让整个系统停机
+    if ((frame->cs & 0x3) || (read_cr2() >= MEM_TASK_BASE)) {
         sys_exit(frame->err_code);
     } else {
         while (1) {
@@ -1,4 +1,5 @@
 #include "dev/dev.h"
+#include "core/slab.h"
 #include "cpu/irq.h"
 #include "tools/klib.h"
 
@@ -10,27 +11,50 @@ static dev_desc_t * dev_desc_tbl[] = {
     &dev_disk_desc
 };
 
-static device_t dev_tbl[DEV_TABLE_SIZE];
+static kmem_cache_t dev_cache;
+static device_t ** dev_tbl;
+static int dev_tbl_size;
 
 static int is_device_id_bad(int dev_id) {
-    if ((dev_id < 0) || (dev_id >= DEV_TABLE_SIZE)) {
+    if ((dev_id < 0) || (dev_id >= dev_tbl_size)) {
         return 1;
     }
-    if (dev_tbl[dev_id].desc == (dev_desc_t *)0) {
+    if (dev_tbl[dev_id] == (device_t *)0) {
         return 1;
     }
     return 0;
 }
 
+// 设备表满时扩大一倍
+static int dev_tbl_grow(void) {
+    int size = dev_tbl_size ? dev_tbl_size * 2 : DEV_TABLE_INIT_SIZE;
+    device_t ** tbl = (device_t **)kmalloc(size * sizeof(device_t *));
+    if (tbl == (device_t **)0) {
+        return -1;
+    }
+    kernel_memset(tbl, 0, size * sizeof(device_t *));
+    if (dev_tbl) {
+        kernel_memcpy(dev_tbl, tbl, dev_tbl_size * sizeof(device_t *));
+        kfree(dev_tbl);
+    } else {
+        kmem_cache_init(&dev_cache, "device", sizeof(device_t));
+    }
+    dev_tbl = tbl;
+    dev_tbl_size = size;
+    return 0;
+}
+
 int dev_open(int major, int minor, void * data) {
 
     irq_state_t state = irq_enter_protection();
 
-    device_t * free_dev = (device_t *)0;
-    for (int i = 0; i < sizeof(dev_tbl) / sizeof(dev_tbl[0]); i++) {
-        device_t * dev = dev_tbl + i;
-        if (free_dev == 0 && dev->open_cnt == 0) {
-            free_dev = dev;
+    int free_id = -1;
+    for (int i = 0; i < dev_tbl_size; i++) {
+        device_t * dev = dev_tbl[i];
+        if (dev == (device_t *)0) {
+            if (free_id < 0) {
+                free_id = i;
+            }
         } else if (dev->minor == minor && dev->desc->major == major) {
             dev->open_cnt++;
             irq_leave_protection(state);
@@ -46,8 +70,22 @@ int dev_open(int major, int minor, void * data) {
             break;
         }
     }
+    if (desc == (dev_desc_t *)0) {
+        irq_leave_protection(state);
+        return -1;
+    }
+
+    if (free_id < 0) {
+        free_id = dev_tbl_size;
+        if (dev_tbl_grow() < 0) {
+            irq_leave_protection(state);
+            return -1;
+        }
+    }
 
-    if (desc && free_dev) {
+    device_t * free_dev = (device_t *)kmem_cache_alloc(&dev_cache);
+    if (free_dev) {
+        kernel_memset(free_dev, 0, sizeof(device_t));
         free_dev->minor = minor;
         free_dev->data = data;
         free_dev->desc = desc;
@@ -55,9 +93,11 @@ int dev_open(int major, int minor, void * data) {
         int err = desc->open(free_dev);
         if (err == 0) {
             free_dev->open_cnt = 1;
+            dev_tbl[free_id] = free_dev;
             irq_leave_protection(state);
-            return free_dev - dev_tbl;
+            return free_id;
         }
+        kmem_cache_free(&dev_cache, free_dev);
     }
 
     irq_leave_protection(state);
@@ -68,7 +108,7 @@ int dev_read(int dev_id, int addr, char * buf, int size) {
     if (is_device_id_bad(dev_id)) {
         return -1;
     }
-    device_t * dev = dev_tbl + dev_id;
+    device_t * dev = dev_tbl[dev_id];
     return dev->desc->read(dev, addr, buf, size);
 }
 
@@ -76,7 +116,7 @@ int dev_write(int dev_id, int addr, char * buf, int size) {
     if (is_device_id_bad(dev_id)) {
         return -1;
     }
-    device_t * dev = dev_tbl + dev_id;
+    device_t * dev = dev_tbl[dev_id];
     return dev->desc->write(dev, addr, buf, size);
 }
 
@@ -84,7 +124,7 @@ int dev_control(int dev_id, int cmd, int arg0, int arg1) {
     if (is_device_id_bad(dev_id)) {
         return -1;
     }
-    device_t * dev = dev_tbl + dev_id;
+    device_t * dev = dev_tbl[dev_id];
     return dev->desc->control(dev, cmd, arg0, arg1);
 }
 
@@ -92,12 +132,13 @@ void dev_close(int dev_id) {
     if (is_device_id_bad(dev_id)) {
         return;
     }
-    device_t * dev = dev_tbl + dev_id;
+    device_t * dev = dev_tbl[dev_id];
     irq_state_t state = irq_enter_protection();
     
     if (--dev->open_cnt <= 0) {
         dev->desc->close(dev);
-        kernel_memset(dev, 0, sizeof(device_t));
+        dev_tbl[dev_id] = (device_t *)0;
+        kmem_cache_free(&dev_cache, dev);
     }
     irq_leave_protection(state);
 }
\ No newline at end of file
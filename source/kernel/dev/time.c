@@ -1,32 +1,334 @@
+#include "applib/lib_syscall.h"
 #include "comm/cpu_instr.h"
 #include "comm/types.h"
 #include "core/task.h"
+#include "core/memory.h"
+#include "core/timer.h"
 #include "dev/time.h"
 #include "os_cfg.h"
 #include "cpu/irq.h"
 
 
-static uint32_t sys_tick;
+static uint32_t sys_ms;             // 启动以来经过的毫秒数，上次同步时更新
+static uint32_t pit_last;           // 上次同步时计数器的值，只在没有TSC时用于计时
+static uint32_t pit_frac;           // 不足1ms的计数
+static int pit_armed;               // 计数器是否已设置过，之前读出的值无意义
+static uint32_t timer_us;           // 定时器已推进到的时间(微秒)，按32位回绕
+
+static uint32_t tsc_khz;            // TSC每毫秒的计数，为0时不使用TSC
+static uint64_t tsc_boot;
+static uint32_t boot_epoch;         // 启动时的实时时间，1970年以来的秒数
+static vdso_time_t * vdso_time;     // 映射给用户只读的时间页
 
 void do_handler_time(exception_frame_t * frame) {
-    sys_tick++;
     pic_send_eoi(IRQ0_TIMER);
 
     task_time_tick();
 }
 
+/**
+ * 64位数除以32位数，内核不链接libgcc，不能直接用64位除法
+ */
+static uint64_t div64_32(uint64_t n, uint32_t d, uint32_t * rem) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t q_lo, r;
+
+    __asm__ __volatile__("divl %[d]":"=a"(q_lo), "=d"(r):"a"(lo), "d"(hi % d), [d]"rm"(d));
+    if (rem) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+static uint32_t pit_read(void) {
+    outb(PIT_COMMAND_MODE_PORT, PIT_CHANNEL | PIT_LATCH);
+    uint32_t count = inb(PIT_CHANNEL0_DATA_PORT);
+    count |= inb(PIT_CHANNEL0_DATA_PORT) << 8;
+    return count;
+}
+
+/**
+ * 单次模式，计数到0时产生一次中断，之后计数器继续从0xFFFF往下减
+ * 没有TSC时由计数器计时，重新装入前先把上次同步以来走过的计数记入pit_frac
+ */
+static void pit_one_shot(uint32_t count) {
+    if (pit_armed && !tsc_khz) {
+        pit_frac += (pit_last - pit_read()) & 0xFFFF;
+    }
+    pit_armed = 1;
+
+    outb(PIT_COMMAND_MODE_PORT, PIT_CHANNEL | PIT_LOAD_LOHI | PIT_MODE0);
+    outb(PIT_CHANNEL0_DATA_PORT, count & 0xFF);
+    outb(PIT_CHANNEL0_DATA_PORT, (count >> 8) & 0xFF);
+    pit_last = count;
+}
+
+uint32_t time_now_ms(void) {
+    return sys_ms;
+}
+
+/**
+ * 由TSC计数换算启动以来的时间
+ */
+static void time_from_tsc(uint64_t tsc, uint32_t * sec, uint32_t * nsec) {
+    uint32_t cycles, ms;
+    uint64_t total_ms = div64_32(tsc - tsc_boot, tsc_khz, &cycles);
+    *sec = (uint32_t)div64_32(total_ms, 1000, &ms);
+    *nsec = ms * 1000000 + (uint32_t)div64_32((uint64_t)cycles * 1000000, tsc_khz, (uint32_t *)0);
+}
+
+/**
+ * 更新用户可见的时间页，用户读到的时间为更新时的单调时间加上之后经过的TSC周期
+ * 没有TSC时只能精确到上次更新的时刻
+ */
+static void time_vdso_update(void) {
+    if (vdso_time == (vdso_time_t *)0) {
+        return;
+    }
+
+    vdso_time->seq++;
+    __asm__ __volatile__("":::"memory");
+
+    vdso_time->ticks_ms = sys_ms;
+    vdso_time->boot_epoch = boot_epoch;
+    if (tsc_khz) {
+        uint32_t sec, nsec;
+        uint64_t tsc = rdtsc();
+        time_from_tsc(tsc, &sec, &nsec);
+        vdso_time->mono_sec = sec;
+        vdso_time->mono_nsec = nsec;
+        vdso_time->tsc_lo = (uint32_t)tsc;
+        vdso_time->tsc_hi = (uint32_t)(tsc >> 32);
+    } else {
+        vdso_time->mono_sec = sys_ms / 1000;
+        vdso_time->mono_nsec = (sys_ms % 1000) * 1000000 + pit_frac * 1000000 / PIT_COUNT_PER_MS;
+    }
+
+    __asm__ __volatile__("":::"memory");
+    vdso_time->seq++;
+}
+
+/**
+ * 统计上次同步以来经过的时间，并推进定时器
+ * 有TSC时按TSC计时，与同步的间隔无关；PIT只负责产生中断
+ * 没有TSC时按PIT的计数计时，计数器按16位回绕，两次同步的间隔须小于一个计数周期
+ */
+void time_sync(void) {
+    irq_state_t state = irq_enter_protection();
+    uint32_t now_us;
+    if (tsc_khz) {
+        uint32_t cycles;
+        sys_ms = (uint32_t)div64_32(rdtsc() - tsc_boot, tsc_khz, &cycles);
+        now_us = sys_ms * 1000 + (uint32_t)div64_32((uint64_t)cycles * 1000, tsc_khz, (uint32_t *)0);
+    } else {
+        uint32_t count = pit_read();
+        pit_frac += (pit_last - count) & 0xFFFF;
+        pit_last = count;
+
+        sys_ms += pit_frac / PIT_COUNT_PER_MS;
+        pit_frac %= PIT_COUNT_PER_MS;
+        now_us = sys_ms * 1000 + pit_frac * 1000 / PIT_COUNT_PER_MS;
+    }
+
+    // 定时器按微秒推进，不足1us的部分留到下次
+    uint32_t us = now_us - timer_us;
+    if (us) {
+        timer_us = now_us;
+        timer_advance(us);
+    }
+    time_vdso_update();
+    irq_leave_protection(state);
+}
+
+/**
+ * 微秒换算为计数值，限制在单次模式可设置的范围内
+ * 已到期的事件也要等一次中断再处理，因此设置一个较短的间隔；向上取整，保证中断到来时事件已经到期
+ */
+static uint32_t time_us_to_count(uint32_t us) {
+    if (us > PIT_ONESHOT_MAX_MS * 1000) {
+        us = PIT_ONESHOT_MAX_MS * 1000;
+    }
+    if (us < TIME_MIN_US) {
+        us = TIME_MIN_US;
+    }
+    return (us * PIT_COUNT_PER_MS + 999) / 1000;
+}
+
+/**
+ * 按最近的定时器到期时间设置下一次中断，有多个任务可运行时每个时钟节拍中断一次以轮转
+ * 没有需要处理的事件时，也至少每PIT_ONESHOT_MAX_MS中断一次以便同步时间
+ * 只在时钟中断及最早的定时器被删除时调用，调用前须先time_sync
+ */
+void time_reprogram(void) {
+    irq_state_t state = irq_enter_protection();
+    uint32_t us = timer_next_us();
+    if (task_need_rotate() && (us > OS_TICKS_MS * 1000)) {
+        us = OS_TICKS_MS * 1000;
+    }
+    pit_one_shot(time_us_to_count(us));
+    irq_leave_protection(state);
+}
+
+/**
+ * 保证us微秒内有一次中断，已设置的中断更晚到来时才重新装入计数器
+ * 计数器中的值就是距离下次中断的计数，不需要先同步时间
+ */
+void time_event_before(uint32_t us) {
+    irq_state_t state = irq_enter_protection();
+    uint32_t count = time_us_to_count(us);
+    if (pit_read() > count) {
+        pit_one_shot(count);
+    }
+    irq_leave_protection(state);
+}
+
+/**
+ * 用PIT通道2计时TSC_CALIBRATE_MS，得到TSC的频率
+ */
+static void tsc_calibrate(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if ((edx & CPUID_FEAT_EDX_TSC) == 0) {
+        tsc_khz = 0;
+        return;
+    }
+
+    uint32_t count = TSC_CALIBRATE_MS * PIT_COUNT_PER_MS;
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_GATE2);
+    outb(PIT_COMMAND_MODE_PORT, PIT_CHANNEL2 | PIT_LOAD_LOHI | PIT_MODE0);
+    outb(PIT_CHANNEL2_DATA_PORT, count & 0xFF);
+    outb(PIT_CHANNEL2_DATA_PORT, (count >> 8) & 0xFF);
+
+    uint64_t start = rdtsc();
+    while ((inb(PIT_GATE_PORT) & PIT_OUT2) == 0) {}
+    uint64_t end = rdtsc();
+    outb(PIT_GATE_PORT, inb(PIT_GATE_PORT) & ~PIT_GATE2);
+
+    tsc_khz = (uint32_t)div64_32(end - start, TSC_CALIBRATE_MS, (uint32_t *)0);
+    tsc_boot = end;
+}
+
+static uint8_t cmos_read(uint8_t reg) {
+    outb(CMOS_ADDR_PORT, reg);
+    return inb(CMOS_DATA_PORT);
+}
+
+static uint32_t bcd_to_bin(uint32_t bcd) {
+    return (bcd & 0xF) + (bcd >> 4) * 10;
+}
+
+/**
+ * 公历日期到1970-01-01的天数
+ */
+static uint32_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = year / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/**
+ * 读CMOS中的实时时钟，RTC可能正在更新，连续两次读到相同的值才采用
+ */
+static uint32_t rtc_read_epoch(void) {
+    uint8_t regs[6], last[6];
+    static const uint8_t addr[6] = {CMOS_SECOND, CMOS_MINUTE, CMOS_HOUR, CMOS_DAY, CMOS_MONTH, CMOS_YEAR};
+
+    int same = 0;
+    for (int i = 0; i < 6; i++) {
+        last[i] = 0xFF;
+    }
+    while (!same) {
+        while (cmos_read(CMOS_STATUS_A) & CMOS_A_UIP) {}
+        same = 1;
+        for (int i = 0; i < 6; i++) {
+            regs[i] = cmos_read(addr[i]);
+            if (regs[i] != last[i]) {
+                same = 0;
+            }
+            last[i] = regs[i];
+        }
+    }
+
+    uint8_t status_b = cmos_read(CMOS_STATUS_B);
+    int pm = regs[2] & CMOS_HOUR_PM;
+    regs[2] &= ~CMOS_HOUR_PM;
+    if (!(status_b & CMOS_B_BINARY)) {
+        for (int i = 0; i < 6; i++) {
+            regs[i] = bcd_to_bin(regs[i]);
+        }
+    }
+    if (!(status_b & CMOS_B_24H)) {
+        regs[2] = (regs[2] % 12) + (pm ? 12 : 0);
+    }
+
+    // 不读世纪寄存器，两位年份按1970~2069处理
+    int year = regs[5] + (regs[5] < 70 ? 2000 : 1900);
+    uint32_t days = days_from_civil(year, regs[4], regs[3]);
+    return days * 86400 + regs[2] * 3600 + regs[1] * 60 + regs[0];
+}
+
+/**
+ * 启动以来的时间，有TSC时精确到纳秒，否则按PIT的计数换算
+ */
+static void time_monotonic(uint32_t * sec, uint32_t * nsec) {
+    if (tsc_khz) {
+        time_from_tsc(rdtsc(), sec, nsec);
+        return;
+    }
+
+    irq_state_t state = irq_enter_protection();
+    time_sync();
+    *sec = sys_ms / 1000;
+    *nsec = (sys_ms % 1000) * 1000000 + pit_frac * 1000000 / PIT_COUNT_PER_MS;
+    irq_leave_protection(state);
+}
+
+int sys_clock_gettime(int clk_id, time_spec_t * ts) {
+    if ((ts == (time_spec_t *)0) || (memory_check_user((uint32_t)ts, sizeof(time_spec_t), 1) < 0)) {
+        return -1;
+    }
+
+    uint32_t sec, nsec;
+    switch (clk_id) {
+        case CLOCK_MONOTONIC:
+            time_monotonic(&sec, &nsec);
+            break;
+        case CLOCK_REALTIME:
+            time_monotonic(&sec, &nsec);
+            sec += boot_epoch;
+            break;
+        default:
+            return -1;
+    }
+
+    ts->sec = sec;
+    ts->nsec = nsec;
+    return 0;
+}
+
 static void init_pit(void) {
-    uint16_t reload_count = OS_TICKS_MS / (1000.0 / PIT_OSC_FREQ);
-    outb(PIT_COMMAND_MODE_PORT, PIT_CHANNEL | PIT_LOAD_LOHI | PIT_MODE3);
-    outb(PIT_CHANNEL0_DATA_PORT, reload_count & 0xFF);
-    outb(PIT_CHANNEL0_DATA_PORT, (reload_count >> 8) & 0xFF);
+    pit_one_shot(OS_TICKS_MS * PIT_COUNT_PER_MS);
 
     irq_install(IRQ0_TIMER, (irq_handler_t)exception_handler_time);
     irq_enable(IRQ0_TIMER);
 }
 
 void time_init(void) {
-    sys_tick = 0;
+    sys_ms = 0;
+    pit_frac = 0;
+    timer_us = 0;
+    boot_epoch = rtc_read_epoch();
+    tsc_calibrate();
+    timer_init();
+
+    vdso_time = (vdso_time_t *)memory_vdso_time();
+    vdso_time->tsc_mult = tsc_khz ? (uint32_t)div64_32((uint64_t)1000000 << VDSO_TSC_SHIFT, tsc_khz, (uint32_t *)0) : 0;
+    time_vdso_update();
+
     init_pit();
 }
-
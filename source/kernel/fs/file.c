@@ -1,29 +1,23 @@
 #include "fs/file.h"
+#include "core/slab.h"
 #include "ipc/mutex.h"
 #include "tools/klib.h"
 
 
-static file_t file_table[FILE_TABLE_SIZE];
+static kmem_cache_t file_cache;
 static mutex_t file_alloc_mutex;
 
 void file_table_init(void) {
     mutex_init(&file_alloc_mutex);
-    kernel_memset(file_table, 0, sizeof(file_table));
+    kmem_cache_init(&file_cache, "file", sizeof(file_t));
 }
 
 file_t * file_alloc(void) {
-    file_t * file = (file_t *)0;
-    mutex_lock(&file_alloc_mutex);
-    for (int i = 0; i < FILE_TABLE_SIZE; i++) {
-        file_t * p_file = file_table + i;
-        if (p_file->ref == 0) {
-            kernel_memset(p_file, 0, sizeof(file_t));
-            p_file->ref = 1;
-            file = p_file;
-            break;
-        }
+    file_t * file = (file_t *)kmem_cache_alloc(&file_cache);
+    if (file) {
+        kernel_memset(file, 0, sizeof(file_t));
+        file->ref = 1;
     }
-    mutex_unlock(&file_alloc_mutex);
     return file;
 }
 
@@ -34,8 +28,13 @@ void file_free(file_t * file) {
     if (file->ref) {
         file->ref--;
     }
+    int ref = file->ref;
     
     mutex_unlock(&file_alloc_mutex);
+
+    if (ref == 0) {
+        kmem_cache_free(&file_cache, file);
+    }
 }
 
 void file_inc_ref(file_t * file) {
@@ -2,6 +2,8 @@
 #include "comm/types.h"
 #include "comm/cpu_instr.h"
 #include "comm/boot_info.h"
+#include "core/memory.h"
+#include "core/slab.h"
 #include "core/task.h"
 #include "cpu/mmu.h"
 #include "dev/console.h"
@@ -17,14 +19,11 @@
 #include "tools/log.h"
 
 
-#define     FS_TABLE_SIZE       10
-
 extern fs_op_t devfs_op;
 extern fs_op_t fatfs_op;
 
 static list_t mounted_list;
-static fs_t fs_table[FS_TABLE_SIZE];
-static list_t free_list;
+static kmem_cache_t fs_cache;
 
 static fs_t * root_fs;
 
@@ -55,12 +54,11 @@ static fs_t * mount(fs_type_t fs_type, char * mount_point, int major, int minor)
         curr = list_node_next(curr);
     }
 
-    list_node_t * free_node = list_remove_first(&free_list);
-    if (!free_node) {
+    fs = (fs_t *)kmem_cache_alloc(&fs_cache);
+    if (!fs) {
         log_printf("no free fs, mount failed.");
         goto mount_failed;
     }
-    fs = field_2_parent(free_node, fs_t, node);
 
     fs_op_t * fs_op = get_fs_op(fs_type, major);
     if (fs_op == (fs_op_t *)0) {
@@ -81,16 +79,13 @@ static fs_t * mount(fs_type_t fs_type, char * mount_point, int major, int minor)
     return fs;
 mount_failed:
     if (fs) {
-        list_insert_last(&free_list, &fs->node);
+        kmem_cache_free(&fs_cache, fs);
     }
     return (fs_t *)0;
 }
 
 static void mounted_list_init(void) {
-    list_init(&free_list);
-    for (int i = 0; i < FS_TABLE_SIZE; i++) {
-        list_insert_first(&free_list, &fs_table[i].node);
-    }
+    kmem_cache_init(&fs_cache, "fs", sizeof(fs_t));
     list_init(&mounted_list);
 }
 
@@ -211,6 +206,10 @@ int sys_read(int file, char * ptr, int len) {
         log_printf("file is write only.");
         return -1;
     }
+    // 文件系统的缓冲区不可重入，先检查用户缓冲区并把缺的页补上
+    if (memory_check_user((uint32_t)ptr, len, 1) < 0) {
+        return -1;
+    }
     fs_t * fs = p_file->fs;
     fs_protect(fs);
     int err = fs->op->read(ptr, len, p_file);
@@ -232,6 +231,9 @@ int sys_write(int file, char * ptr, int len) {
         log_printf("file is read only.");
         return -1;
     }
+    if (memory_check_user((uint32_t)ptr, len, 0) < 0) {
+        return -1;
+    }
     fs_t * fs = p_file->fs;
     fs_protect(fs);
     int err = fs->op->write(ptr, len, p_file);
@@ -266,16 +268,49 @@ int sys_close(int file) {
         log_printf("file not opened");
         return -1;
     }
-    ASSERT(p_file->ref > 0);
-    if (p_file->ref-- == 1) {
-        fs_t * fs = p_file->fs;
+    fs_close_file(p_file);
+    task_remove_fd(file);
+    return 0;
+}
+
+void fs_close_file(file_t * file) {
+    ASSERT(file->ref > 0);
+    if (file->ref-- == 1) {
+        fs_t * fs = file->fs;
         fs_protect(fs);
-        fs->op->close(p_file);
+        fs->op->close(file);
         fs_unprotect(fs);
-        file_free(p_file);
+        file_free(file);
     }
-    task_remove_fd(file);
-    return 0;
+}
+
+// 按偏移读写文件，不影响文件原来的读写位置
+int fs_read_file(file_t * file, uint32_t offset, char * buf, int size) {
+    fs_t * fs = file->fs;
+    fs_protect(fs);
+    int pos = file->pos, curr_blk = file->curr_blk;
+    int err = fs->op->seek(file, offset, 0);
+    if (err >= 0) {
+        err = fs->op->read(buf, size, file);
+    }
+    file->pos = pos;
+    file->curr_blk = curr_blk;
+    fs_unprotect(fs);
+    return err;
+}
+
+int fs_write_file(file_t * file, uint32_t offset, char * buf, int size) {
+    fs_t * fs = file->fs;
+    fs_protect(fs);
+    int pos = file->pos, curr_blk = file->curr_blk;
+    int err = fs->op->seek(file, offset, 0);
+    if (err >= 0) {
+        err = fs->op->write(buf, size, file);
+    }
+    file->pos = pos;
+    file->curr_blk = curr_blk;
+    fs_unprotect(fs);
+    return err;
 }
 
 int sys_isatty(int file) {
@@ -300,6 +335,10 @@ int sys_fstat(int file, struct stat * st) {
         return -1;
     }
 
+    if (memory_check_user((uint32_t)st, sizeof(struct stat), 1) < 0) {
+        return -1;
+    }
+
     kernel_memset(st, 0, sizeof(struct stat));
     fs_t * fs = p_file->fs;
     fs_protect(fs);
@@ -339,7 +378,15 @@ int sys_dup(int file) {
     return -1;
 }
 
+/**
+ * 目录的读取结果写在用户的DIR中，持有文件系统的锁之前先检查并补齐缺页
+ * 否则写入时缺页再去读文件，会改写fat缓冲区中正在复制的目录项
+ */
 int sys_opendir(const char * name, DIR * dir) {
+    if (memory_check_user((uint32_t)dir, sizeof(DIR), 1) < 0) {
+        return -1;
+    }
+
     fs_protect(root_fs);
     int err = root_fs->op->opendir(root_fs, name, dir);
     fs_unprotect(root_fs);
@@ -347,6 +394,10 @@ int sys_opendir(const char * name, DIR * dir) {
 }
 
 int sys_readdir(DIR * dir, struct dirent * dirent) {
+    if (memory_check_user((uint32_t)dir, sizeof(DIR), 1) < 0) {
+        return -1;
+    }
+
     fs_protect(root_fs);
     int err = root_fs->op->readdir(root_fs, dir, &dir->dirent);
     fs_unprotect(root_fs);
@@ -355,6 +406,10 @@ int sys_readdir(DIR * dir, struct dirent * dirent) {
 
 
 int sys_closedir(DIR * dir) {
+    if (memory_check_user((uint32_t)dir, sizeof(DIR), 1) < 0) {
+        return -1;
+    }
+
     fs_protect(root_fs);
     int err = root_fs->op->closedir(root_fs, dir);
     fs_unprotect(root_fs);
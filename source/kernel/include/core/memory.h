@@ -3,8 +3,9 @@
 
 #include "comm/boot_info.h"
 #include "comm/types.h"
-#include "ipc/mutex.h"
-#include "tools/bitmap.h"
+#include "tools/list.h"
+
+struct _mmap_args_t;
 
 
 #define     MEM_EXT_START       (1024*1024)
@@ -15,14 +16,34 @@
 #define     MEM_TASK_STACK_TOP  0xE0000000
 #define     MEM_TASK_STACK_SIZE (MEM_PAGE_SIZE * 500)
 #define     MEM_TASK_ARG_SIZE   (MEM_PAGE_SIZE * 4)
+#define     MEM_TASK_MMAP_BASE  0xC0000000
+
+// 栈顶之上映射给用户只读的两页：所有进程共享的时间页、每个地址空间自己的进程页
+#define     MEM_VDSO_TIME       0xE0000000
+#define     MEM_VDSO_PROC       (MEM_VDSO_TIME + MEM_PAGE_SIZE)
+#define     MEM_VDSO_END        (MEM_VDSO_PROC + MEM_PAGE_SIZE)
+
+
+#define     MEM_BUDDY_ORDER_MAX 10
+#define     MEM_ZERO_POOL_SIZE  32
+
+#define     PAGE_FREE           (1 << 0)
 
+// 物理页的描述信息
+typedef struct _page_t {
+    list_node_t node;
+    void * slab;
+    uint16_t ref;
+    uint8_t order;
+    uint8_t flags;
+}page_t;
 
 typedef struct _addr_alloc_t {
-    mutex_t mutex;
-    bitmap_t bitmap;
     uint32_t start;
     uint32_t size;
-    uint32_t page_size;
+    int page_count;
+    page_t * pages;
+    list_t free_list[MEM_BUDDY_ORDER_MAX + 1];
 }addr_alloc_t;
 
 typedef struct _memory_map_t {
@@ -33,15 +54,31 @@ typedef struct _memory_map_t {
 }memory_map_t;
 
 void memory_init(boot_info_t * boot_info);
-uint32_t memory_create_uvm(void);
-uint32_t memory_copy_uvm(uint32_t page_dir);
+void memory_show_info(boot_info_t * boot_info);
+void memory_vdso_init(void);
+void * memory_vdso_time(void);
+void memory_vdso_set_pid(uint32_t proc_page, int pid);
+uint32_t memory_create_uvm(uint32_t * proc_page);
+uint32_t memory_copy_uvm(uint32_t page_dir, uint32_t * proc_page);
 void memory_destroy_uvm(uint32_t page_dir);
 int memory_alloc_page_for(uint32_t vaddr, uint32_t size, int perm);
 int memory_alloc_for_page_dir(uint32_t page_dir, uint32_t vaddr, uint32_t size, int perm);
 uint32_t memory_alloc_page(void);
+uint32_t memory_alloc_pages(int page_count);
+uint32_t memory_alloc_zeroed_page(void);
+int memory_fill_zero_pool(void);
+page_t * memory_get_page(uint32_t paddr);
+void memory_release_page(uint32_t paddr);
 void memory_free_page(uint32_t addr);
+int memory_free_count(int order);
 uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr);
+int memory_handle_page_fault(uint32_t vaddr, uint32_t err_code);
+int memory_prefault(uint32_t vaddr, uint32_t size);
+int memory_check_user(uint32_t vaddr, uint32_t size, int write);
 int memory_copy_uvm_data(uint32_t to, uint32_t page_dir, uint32_t from, uint32_t size);
 char * sys_sbrk(int incr);
+void * sys_mmap(struct _mmap_args_t * args);
+int sys_munmap(void * addr, int length);
+void memory_munmap_all(uint32_t page_dir, list_t * vma_list);
 
 #endif
\ No newline at end of file
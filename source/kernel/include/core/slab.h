@@ -0,0 +1,44 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+
+#define     SLAB_ALIGN              16
+#define     SLAB_MIN_OBJ_CNT        4
+#define     SLAB_ORDER_MAX          3
+#define     KMALLOC_MIN_SHIFT       4
+#define     KMALLOC_MAX_SHIFT       11
+
+struct _kmem_cache_t;
+
+// 一块slab由2^order个连续物理页组成，开头存放slab_t，后面是对象
+typedef struct _slab_t {
+    struct _kmem_cache_t * cache;
+    list_node_t node;
+    void * free_obj;
+    int inuse;
+}slab_t;
+
+// 同一类型对象的缓存
+typedef struct _kmem_cache_t {
+    const char * name;
+    int obj_size;
+    int obj_per_slab;
+    int order;
+    int inuse;
+
+    list_t partial_list;
+    list_t full_list;
+    list_t empty_list;
+}kmem_cache_t;
+
+void kmem_init(void);
+void kmem_cache_init(kmem_cache_t * cache, const char * name, int obj_size);
+void * kmem_cache_alloc(kmem_cache_t * cache);
+void kmem_cache_free(kmem_cache_t * cache, void * obj);
+
+void * kmalloc(int size);
+void kfree(void * ptr);
+
+#endif
@@ -10,6 +10,22 @@
 #define     SYS_yield               5
 #define     SYS_exit                6
 #define     SYS_wait                7
+#define     SYS_mmap                8
+#define     SYS_munmap              9
+#define     SYS_shmget              10
+#define     SYS_shmat               11
+#define     SYS_shmdt               12
+#define     SYS_shmrm               13
+#define     SYS_setpriority         14
+#define     SYS_getpriority         15
+#define     SYS_clock_gettime       16
+#define     SYS_nanosleep           17
+#define     SYS_waitpid             18
+#define     SYS_vfork               19
+#define     SYS_spawn               20
+#define     SYS_clone               21
+#define     SYS_ring_setup          22
+#define     SYS_ring_enter          23
 
 #define     SYS_open                50
 #define     SYS_read                51
@@ -31,6 +47,8 @@
 
 #define     SYSCALL_PARAM_COUNT     5
 
+#ifndef __ASSEMBLER__
+
 typedef struct _syscall_frame_t{
     int eflags;
     int gs, fs, es, ds;
@@ -41,7 +59,10 @@ typedef struct _syscall_frame_t{
 }syscall_frame_t;
 
 void exception_handler_syscall(void);
+void exception_handler_sysenter(void);
 
 void do_handler_syscall(syscall_frame_t * frame);
 
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,10 @@
+#ifndef SYSRING_H
+#define SYSRING_H
+
+#include "applib/lib_syscall.h"
+
+// 批量系统调用环，sysring_t与应用库共用同一定义
+int sys_ring_setup(sysring_t * ring);
+int sys_ring_enter(int to_submit);
+
+#endif
@@ -3,17 +3,60 @@
 
 #include "cpu/cpu.h"
 #include "comm/types.h"
+#include "core/timer.h"
 #include "fs/file.h"
+#include "os_cfg.h"
+#include "tools/bitmap.h"
 #include "tools/list.h"
 
 #define     TASK_NAME_SIZE              32
 #define     TASK_OFILE_NR               128
-#define     TASK_TIME_SLICE_DEFAULT     10
+
+// 优先级0最高，各级有自己的就绪队列，级别越低时间片越长
+#define     TASK_PRIO_NR                8
+#define     TASK_PRIO_DEFAULT           2
+#define     TASK_PRIO_SLICE_MS(prio)    (((prio) + 1) * 2 * OS_TICKS_MS)
+#define     TASK_BOOST_MS               1000
+
+#define     PRIO_PROCESS                0
+
+#define     TASK_SLEEP_MAX_SEC          1000
+
+// pid从0开始顺序分配，超过TASK_PID_MAX后回绕，小于TASK_PID_REUSE的pid不回收
+#define     TASK_PID_MAX                32767
+#define     TASK_PID_REUSE              2
+#define     TASK_PID_HASH_SIZE          64
 
 #define     TASK_FLAGS_SYSTEM           (1 << 0)
+#define     TASK_FLAGS_SHARE_VM         (1 << 1)
+
+#define     WAIT_NOHANG                 (1 << 0)
+#define     TASK_SPAWN_FD_NR            3
+
+struct _time_spec_t;
+struct _fpu_state_t;
+struct _sysring_t;
+
+typedef int (*kthread_fn_t)(void * arg);
+
+// 地址空间，同一进程的线程共用，最后一个使用者回收时释放
+typedef struct _task_mm_t {
+    int ref;
+    uint32_t page_dir;
+    uint32_t proc_page;             // 进程页的内核地址，创建地址空间时记下
+    list_t vma_list;
+    uint32_t heap_start;
+    uint32_t heap_end;
+}task_mm_t;
+
+// 打开的文件表，线程间共用
+typedef struct _task_files_t {
+    int ref;
+    file_t * table[TASK_OFILE_NR];
+}task_files_t;
 
 typedef struct _task_t {
-    // uint32_t * stack;
+    uint32_t * stack;               // 切换出去时内核栈的位置
     enum {
         TASK_CREATED, 
         TASK_RUNNING,
@@ -21,27 +64,37 @@ typedef struct _task_t {
         TASK_READY,
         TASK_WAITTING,
         TASK_ZOMBIE,
+        TASK_BLOCKED,
     }state;
 
     int pid;
 
     struct _task_t * parent;
-    uint32_t heap_start;
-    uint32_t heap_end;
-
-    int sleep_ticks;
-    int time_ticks;
-    int slice_ticks;
+    struct _task_t * vfork_parent;  // vfork后等待子进程execve或退出的父进程
+    kthread_fn_t kthread_fn;        // 内核线程的入口及参数
+    void * kthread_arg;
+    list_t child_list;              // 运行中的子进程
+    list_t zombie_list;             // 已退出、等待回收的子进程
+    list_node_t child_node;         // 在父进程child_list或zombie_list中的结点
+
+    ktimer_t sleep_timer;
+    int prio;                       // 当前所在的优先级
+    int base_prio;                  // 设置的优先级，prio不会高于它
+    uint32_t slice_end;             // 时间片结束的时间(毫秒)
     int status;
 
-    file_t * file_table[TASK_OFILE_NR];
+    task_mm_t * mm;
+    task_files_t * files;
+    struct _fpu_state_t * fpu;      // FPU/SSE状态，首次使用FPU时才分配
+    struct _sysring_t * ring;       // 登记的批量系统调用环，在用户空间中
 
     char name[TASK_NAME_SIZE];
     list_node_t run_node;
     list_node_t wait_node;
     list_node_t all_node;
-    tss_t tss;
-    int tss_sel;
+    list_node_t pid_node;           // pid散列表中的结点
+
+    uint32_t kernel_stack;          // 内核栈所在的页，栈顶即esp0
 }task_t;
 
 typedef struct _task_args_t {
@@ -54,20 +107,31 @@ typedef struct _task_manager_t {
 
     task_t * curr_task;
 
-    list_t ready_list;
+    list_t ready_list[TASK_PRIO_NR];
+    uint32_t ready_bitmap;          // 非空的就绪队列
+    int ready_count;
+    uint32_t boost_time;            // 上次把所有任务恢复到原优先级的时间
     list_t task_list;
-    list_t sleep_list;
+    list_t pid_hash[TASK_PID_HASH_SIZE];
+    bitmap_t pid_map;               // 已分配的pid
 
     task_t first_task;
     task_t idle_task;
 
     int app_code_sel;
     int app_data_sel;
+
+    // 所有任务共用一个TSS，只用于特权级切换时加载esp0
+    tss_t tss;
+    int tss_sel;
 }task_manager_t;
 
 
 int task_init(task_t * task, char * name, int flag, uint32_t entry, uint32_t esp);
+task_t * kthread_create(char * name, kthread_fn_t fn, void * arg);
 void task_switch_from_to(task_t * from, task_t * to);
+void simple_switch(uint32_t ** from, uint32_t * to);
+void task_entry(void);
 
 void task_manager_init(void);
 void task_first_init(void);
@@ -79,14 +143,22 @@ task_t * task_current(void);
 int sys_yield(void);
 void task_dispatch(void);
 void task_time_tick(void);
-void task_set_sleep(task_t * task, uint32_t ticks);
+int task_need_rotate(void);
+void task_set_sleep(task_t * task, uint32_t us);
 void task_set_wakeup(task_t * task);
 void sys_sleep(uint32_t ms);
+int sys_nanosleep(const struct _time_spec_t * req, struct _time_spec_t * rem);
 int sys_getpid(void);
 int sys_fork(void);
+int sys_vfork(void);
+int sys_clone(uint32_t entry, uint32_t esp);
+int sys_spawn(char * name, char ** argv, int * fd_map);
 int sys_execve(char * name, char ** array, char ** env);
 void sys_exit(int status);
 int sys_wait(int * status);
+int sys_waitpid(int pid, int * status, int options);
+int sys_setpriority(int which, int who, int prio);
+int sys_getpriority(int which, int who);
 
 file_t * task_file(int fd);
 int task_alloc_fd(file_t * file);
@@ -0,0 +1,27 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "comm/types.h"
+#include "tools/list.h"
+
+struct _ktimer_t;
+
+// 定时器到期时在时钟中断中调用，中断处于关闭状态
+typedef void (*timer_proc_t)(struct _ktimer_t * timer, void * arg);
+
+// 内核定时器，按到期时间排序，每个定时器只记录与前一个定时器的时间差(微秒)
+typedef struct _ktimer_t {
+    list_node_t node;
+    uint32_t delta;
+    timer_proc_t proc;
+    void * arg;
+    int active;
+}ktimer_t;
+
+void timer_init(void);
+void timer_add(ktimer_t * timer, uint32_t us, timer_proc_t proc, void * arg);
+void timer_remove(ktimer_t * timer);
+void timer_advance(uint32_t us);
+uint32_t timer_next_us(void);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include "comm/types.h"
+#include "fs/file.h"
+#include "tools/list.h"
+
+#define     VMA_ANON            (1 << 0)
+#define     VMA_FILE            (1 << 1)
+#define     VMA_HEAP            (1 << 2)
+#define     VMA_STACK           (1 << 3)
+#define     VMA_MMAP            (1 << 4)
+#define     VMA_SHARED          (1 << 5)
+#define     VMA_SHM             (1 << 6)
+
+struct _shm_t;
+
+// 进程虚拟地址空间中的一段区域，页面在首次访问时才分配
+typedef struct _vma_t {
+    uint32_t start;
+    uint32_t end;
+    uint32_t perm;
+    int flags;
+
+    // 文件映射: [start, start + file_size) 对应文件中从file_offset开始的内容，其余部分填0
+    file_t * file;
+    uint32_t file_offset;
+    uint32_t file_size;
+
+    struct _shm_t * shm;        // 共享内存段，页直接映射到段的物理页上
+
+    list_node_t node;
+}vma_t;
+
+void vma_init(void);
+vma_t * vma_create(list_t * vma_list, uint32_t start, uint32_t end, uint32_t perm, int flags);
+void vma_set_file(vma_t * vma, file_t * file, uint32_t offset, uint32_t size);
+vma_t * vma_split(list_t * vma_list, vma_t * vma, uint32_t addr);
+vma_t * vma_find(list_t * vma_list, uint32_t vaddr);
+vma_t * vma_find_flags(list_t * vma_list, int flags);
+uint32_t vma_find_free(list_t * vma_list, uint32_t start, uint32_t end, uint32_t size);
+void vma_destroy(list_t * vma_list, vma_t * vma);
+int vma_copy(list_t * to, list_t * from);
+void vma_destroy_all(list_t * vma_list);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "core/task.h"
+#include "tools/list.h"
+
+struct _work_t;
+
+typedef void (*work_fn_t)(struct _work_t * work);
+
+// 延后到内核线程中执行的工作，已在队列中时不会重复加入
+typedef struct _work_t {
+    list_node_t node;
+    work_fn_t fn;
+    int pending;
+}work_t;
+
+// 每个工作队列由一个内核线程按加入的顺序依次执行
+typedef struct _workqueue_t {
+    list_t work_list;
+    task_t * worker;
+    int idle;                       // 队列为空，线程已阻塞
+}workqueue_t;
+
+void work_init(work_t * work, work_fn_t fn);
+int workqueue_init(workqueue_t * wq, char * name);
+int workqueue_add(workqueue_t * wq, work_t * work);
+void workqueue_system_init(void);
+int work_schedule(work_t * work);
+
+#endif
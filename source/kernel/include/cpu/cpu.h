@@ -57,12 +57,16 @@ typedef struct _tss_t{
 #define     GATE_TYPE_INT       (0xE << 8)
 #define     GATE_TYPE_SYSCALL   (0xC << 8)
 
+#define     MSR_SYSENTER_CS     0x174
+#define     MSR_SYSENTER_ESP    0x175
+#define     MSR_SYSENTER_EIP    0x176
+
 
 void segment_desc_set (int selector, uint32_t base, uint32_t limit, uint16_t attr);
 void gate_desc_set (gate_desc_t * desc, uint16_t selector, uint32_t offset, uint16_t attr);
 void cpu_init(void);
+void cpu_sysenter_set_stack(tss_t * tss);
 int gdt_alloc_desc(void);
 void gdt_free_desc(int sel);
-void switch_to_tss(int tss_sel);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "comm/types.h"
+#include "core/task.h"
+
+#define     CR0_MP                  (1 << 1)
+#define     CR0_EM                  (1 << 2)
+#define     CR0_TS                  (1 << 3)
+#define     CR0_NE                  (1 << 5)
+#define     CR4_OSFXSR              (1 << 9)
+#define     CR4_OSXMMEXCPT          (1 << 10)
+
+#define     CPUID_FEAT_EDX_FXSR     (1 << 24)
+#define     CPUID_FEAT_EDX_SSE      (1 << 25)
+
+#define     FPU_STATE_SIZE          512
+
+// fxsave保存的区域，slab按16字节对齐分配
+typedef struct _fpu_state_t {
+    uint8_t data[FPU_STATE_SIZE];
+}fpu_state_t;
+
+void fpu_init(void);
+void fpu_switch(task_t * to);
+int fpu_handle_unavailable(void);
+int fpu_copy(task_t * to, task_t * from);
+void fpu_release(task_t * task);
+
+#endif
@@ -12,7 +12,19 @@
 #define     PDE_W       (1 << 1)
 #define     PTE_W       (1 << 1)
 #define     PTE_U       (1 << 2)
+#define     PTE_A       (1 << 5)
+#define     PTE_D       (1 << 6)
 #define     PDE_U       (1 << 2)
+#define     PDE_PS      (1 << 7)
+#define     PTE_G       (1 << 8)
+#define     PTE_COW     (1 << 9)
+#define     PTE_SHARED  (1 << 10)
+
+#define     CR0_WP      (1 << 16)
+#define     CR4_PSE     (1 << 4)
+#define     CR4_PGE     (1 << 7)
+
+#define     MEM_LARGE_PAGE_SIZE     (4 * 1024 * 1024)
 
 
 
@@ -70,7 +82,7 @@ static inline uint32_t pte_paddr(pte_t * pte) {
 }
 
 static inline uint32_t get_pte_perm(pte_t * pte) {
-    return (pte->v & 0x3FF);
+    return (pte->v & 0xFFF);
 }
 
 #endif
\ No newline at end of file
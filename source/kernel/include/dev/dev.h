@@ -2,7 +2,7 @@
 #define DEV_H
 
 #define DEV_NAME_SIZE       32
-#define DEV_TABLE_SIZE      128
+#define DEV_TABLE_INIT_SIZE 16
 
 enum {
     DEV_UNKNOWN = 0,
@@ -1,16 +1,58 @@
 #ifndef TIME_H
 #define TIME_H
 
+#include "comm/types.h"
+
 #define     PIT_OSC_FREQ            1193182
 #define     PIT_COMMAND_MODE_PORT   0x43
 #define     PIT_CHANNEL0_DATA_PORT  0x40
 
 #define     PIT_CHANNEL             (0 << 6)
+#define     PIT_LATCH               (0 << 4)
 #define     PIT_LOAD_LOHI           (3 << 4)
+#define     PIT_MODE0               (0 << 1)
 #define     PIT_MODE3               (3 << 1)
 
+#define     PIT_COUNT_PER_MS        (PIT_OSC_FREQ / 1000)
+#define     PIT_ONESHOT_MAX_MS      (0xFFFF / PIT_COUNT_PER_MS)
+
+#define     TIME_NO_EVENT           0xFFFFFFFF
+#define     TIME_MIN_US             50
+
+// 通道2用于校准TSC，计数期间由0x61端口控制门控并查看输出
+#define     PIT_CHANNEL2_DATA_PORT  0x42
+#define     PIT_CHANNEL2            (2 << 6)
+#define     PIT_GATE_PORT           0x61
+#define     PIT_GATE2               (1 << 0)
+#define     PIT_SPEAKER             (1 << 1)
+#define     PIT_OUT2                (1 << 5)
+#define     TSC_CALIBRATE_MS        50
+
+#define     CPUID_FEAT_EDX_TSC      (1 << 4)
+
+#define     CMOS_ADDR_PORT          0x70
+#define     CMOS_DATA_PORT          0x71
+#define     CMOS_SECOND             0x00
+#define     CMOS_MINUTE             0x02
+#define     CMOS_HOUR               0x04
+#define     CMOS_DAY                0x07
+#define     CMOS_MONTH              0x08
+#define     CMOS_YEAR               0x09
+#define     CMOS_STATUS_A           0x0A
+#define     CMOS_STATUS_B           0x0B
+#define     CMOS_A_UIP              (1 << 7)
+#define     CMOS_B_24H              (1 << 1)
+#define     CMOS_B_BINARY           (1 << 2)
+#define     CMOS_HOUR_PM            (1 << 7)
+
+struct _time_spec_t;
 
 void time_init(void);
 void exception_handler_time(void);
+uint32_t time_now_ms(void);
+void time_sync(void);
+void time_reprogram(void);
+void time_event_before(uint32_t us);
+int sys_clock_gettime(int clk_id, struct _time_spec_t * ts);
 
-#endif
\ No newline at end of file
+#endif
@@ -4,7 +4,6 @@
 #include "comm/types.h"
 
 #define FILE_NAME_SIZE      32
-#define FILE_TABLE_SIZE     2048
 
 typedef enum _file_type_t {
     FILE_UNKNOWN = 0,
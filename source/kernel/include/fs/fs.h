@@ -68,6 +68,10 @@ int sys_readdir(DIR * dir, struct dirent * dirent);
 int sys_closedir(DIR * dir);
 int sys_unlink(const char * path_name);
 
+void fs_close_file(file_t * file);
+int fs_read_file(file_t * file, uint32_t offset, char * buf, int size);
+int fs_write_file(file_t * file, uint32_t offset, char * buf, int size);
+
 int path_2_num(const char * path, int * num);
 const char * path_next_child(const char * name);
 
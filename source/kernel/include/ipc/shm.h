@@ -0,0 +1,40 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "comm/types.h"
+#include "fs/file.h"
+#include "tools/list.h"
+
+#define SHM_NAME_SIZE       32
+#define SHM_SIZE_MAX        (4 * 1024 * 1024)
+
+// 共享内存段，物理页在创建时分配，各进程映射同一组物理页
+// 共享的mmap也用它作为后备，其物理页在首次访问时才分配，文件映射时即为该文件的页缓存
+typedef struct _shm_t {
+    char name[SHM_NAME_SIZE];
+    int id;
+    int size;
+    int page_count;
+    uint32_t * pages;
+
+    file_t * file;          // 页缓存对应的文件，页从文件中对应的位置读入
+
+    int ref;                // 被映射的次数
+    int removed;            // 已被删除，最后一次解除映射后释放
+
+    list_node_t node;
+}shm_t;
+
+void shm_init(void);
+void shm_get(shm_t * shm);
+void shm_put(shm_t * shm);
+uint32_t shm_page(shm_t * shm, int index);
+shm_t * shm_create_anon(int size);
+shm_t * shm_get_file(file_t * file, uint32_t size);
+
+int sys_shmget(const char * name, int size);
+void * sys_shmat(int id, void * addr);
+int sys_shmdt(void * addr);
+int sys_shmrm(int id);
+
+#endif
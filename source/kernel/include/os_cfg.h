@@ -4,7 +4,10 @@
 #define     GDT_TABLE_SIZE      256
 #define     KERNEL_SELECTOR_CS  (1 * 8)
 #define     KERNEL_SELECTOR_DS  (2 * 8)
-#define     SELECTOR_SYSCALL    (3 * 8)
+// SYSEXIT要求用户代码段、数据段依次紧跟在内核代码段、数据段之后
+#define     APP_SELECTOR_CS     (3 * 8)
+#define     APP_SELECTOR_DS     (4 * 8)
+#define     SELECTOR_SYSCALL    (5 * 8)
 #define     KERNEL_STACK_SIZE   (8 * 1024)
 
 #define     OS_TICKS_MS         10
@@ -13,8 +16,6 @@
 
 #define     IDLE_TASK_STACK_SIZE    1024
 
-#define     TASK_NR             128
-
 #define     ROOT_DEV            DEV_DISK, 0xb1
 
 #endif
\ No newline at end of file
@@ -3,10 +3,13 @@
 
 #include "comm/types.h"
 
+#define BITMAP_WORD_BITS        32
+
 
 typedef struct _bitmap_t {
     int bit_count;
-    uint8_t * bits;
+    int next;                   // 下次分配时开始搜索的位置
+    uint32_t * bits;
 }bitmap_t;
 
 
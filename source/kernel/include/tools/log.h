@@ -3,5 +3,6 @@
 
 void log_init(void);
 void log_printf(const char * fmt, ...);
+void log_flush(void);
 
 #endif
\ No newline at end of file
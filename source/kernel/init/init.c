@@ -2,12 +2,15 @@
 #include "comm/cpu_instr.h"
 #include "core/memory.h"
 #include "core/task.h"
+#include "core/workqueue.h"
+#include "cpu/fpu.h"
 #include "cpu/irq.h"
 #include "dev/console.h"
 #include "dev/keyboard.h"
 #include "dev/time.h"
 #include "fs/fs.h"
 #include "ipc/sem.h"
+#include "ipc/shm.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 #include "os_cfg.h"
@@ -18,10 +21,13 @@ void kernel_init(boot_info_t * boot_info) {
 
     cpu_init();
     irq_init();
-    log_init();
     memory_init(boot_info);
+    log_init();
+    memory_show_info(boot_info);
     fs_init();
+    shm_init();
     time_init();
+    fpu_init();
     task_manager_init();
 }
 
@@ -29,15 +35,9 @@ void move_to_first_task(void) {
     task_t * curr = task_current();
     ASSERT(curr != 0);
 
-    tss_t * tss = &(curr->tss);
-    __asm__ __volatile__ (
-        "push %[ss]\n\t"
-        "push %[esp]\n\t"
-        "push %[eflags]\n\t"
-        "push %[cs]\n\t"
-        "push %[eip]\n\t"
-        "iret"::[ss]"r"(tss->ss), [esp]"r"(tss->esp), [eflags]"r"(tss->eflags), [cs]"r"(tss->cs), [eip]"r"(tss->eip)
-    );
+    // 切换到第一个任务的内核栈，从其初始栈帧返回到用户态
+    uint32_t * boot_stack;
+    simple_switch(&boot_stack, curr->stack);
 }
 
 void init_main(void) {
@@ -45,8 +45,9 @@ void init_main(void) {
     log_printf("Kernel is running...");
     log_printf("Version: %s %s", OS_VERSION, "diyx86 os");
     log_printf("==============================");
-    
+
     task_first_init();
+    workqueue_system_init();
     move_to_first_task();
 }
 
@@ -1,11 +1,47 @@
 #include "applib/lib_syscall.h"
 #include "applib/lib_syscall.h"
+#include "comm/cpu_instr.h"
 #include "core/syscall.h"
 #include "os_cfg.h"
 #include "comm/types.h"
 
 
+static int sysenter_state;          // 0未检测，1使用sysenter，-1使用调用门
+
+/**
+ * 通过sysenter进入内核，参数放在寄存器中，不经过调用门的权限检查和参数复制
+ * 返回时ecx、edx被内核用于恢复用户栈和返回地址
+ * sysexit不恢复标志寄存器，进入前由用户自己保存，返回后恢复DF、AC及算术标志
+ */
+static inline int sys_call_fast(syscall_args_t * args) {
+    int ret;
+    int arg1 = args->args1, arg2 = args->args2;
+    __asm__ __volatile__ (
+        "pushfl\n\t"
+        "push %%ebp\n\t"
+        "mov %%esp, %%ebp\n\t"
+        "lea 1f, %%edi\n\t"
+        "sysenter\n"
+        "1:\n\t"
+        "pop %%ebp\n\t"
+        "popfl"
+        :"=a"(ret), "+c"(arg1), "+d"(arg2):
+        "a"(args->id),
+        "b"(args->args0),
+        "S"(args->args3)
+        :"edi", "cc", "memory"
+    );
+    return ret;
+}
+
 static inline int sys_call(syscall_args_t * args) {
+    if (sysenter_state == 0) {
+        sysenter_state = cpu_has_sysenter() ? 1 : -1;
+    }
+    if (sysenter_state > 0) {
+        return sys_call_fast(args);
+    }
+
     uint32_t addr[] = {0, SELECTOR_SYSCALL | 0};
     int ret;
     __asm__ __volatile__ (
@@ -0,0 +1,337 @@
+#include "ipc/shm.h"
+#include "core/memory.h"
+#include "core/slab.h"
+#include "core/task.h"
+#include "core/vma.h"
+#include "cpu/mmu.h"
+#include "fs/fs.h"
+#include "ipc/mutex.h"
+#include "tools/klib.h"
+#include "tools/list.h"
+#include "tools/log.h"
+
+
+static list_t shm_list;
+static list_t shm_file_list;        // 共享文件映射的页缓存，每个文件一个
+static kmem_cache_t shm_cache;
+static mutex_t shm_mutex;
+static int shm_next_id;
+
+void shm_init(void) {
+    list_init(&shm_list);
+    list_init(&shm_file_list);
+    kmem_cache_init(&shm_cache, "shm", sizeof(shm_t));
+    mutex_init(&shm_mutex);
+    shm_next_id = 1;
+}
+
+static shm_t * shm_find_id(int id) {
+    list_node_t * node = list_first(&shm_list);
+    while (node) {
+        shm_t * shm = field_2_parent(node, shm_t, node);
+        if (shm->id == id) {
+            return shm;
+        }
+        node = list_node_next(node);
+    }
+    return (shm_t *)0;
+}
+
+static shm_t * shm_find_name(const char * name) {
+    list_node_t * node = list_first(&shm_list);
+    while (node) {
+        shm_t * shm = field_2_parent(node, shm_t, node);
+        if ((kernel_strlen(shm->name) == kernel_strlen(name)) && (kernel_strncmp(shm->name, name, SHM_NAME_SIZE) == 0)) {
+            return shm;
+        }
+        node = list_node_next(node);
+    }
+    return (shm_t *)0;
+}
+
+static shm_t * shm_find_file(file_t * file) {
+    list_node_t * node = list_first(&shm_file_list);
+    while (node) {
+        shm_t * shm = field_2_parent(node, shm_t, node);
+        if ((shm->file->fs == file->fs) && (shm->file->dir_index == file->dir_index)) {
+            return shm;
+        }
+        node = list_node_next(node);
+    }
+    return (shm_t *)0;
+}
+
+static void shm_free(shm_t * shm) {
+    for (int i = 0; i < shm->page_count; i++) {
+        if (shm->pages[i]) {
+            memory_release_page(shm->pages[i]);
+        }
+    }
+    if (shm->pages) {
+        kfree(shm->pages);
+    }
+    if (shm->file) {
+        fs_close_file(shm->file);
+    }
+    kmem_cache_free(&shm_cache, shm);
+}
+
+/**
+ * 分配段及记录其物理页的数组，物理页由调用者分配
+ */
+static shm_t * shm_alloc(int size) {
+    shm_t * shm = (shm_t *)kmem_cache_alloc(&shm_cache);
+    if (shm == (shm_t *)0) {
+        return (shm_t *)0;
+    }
+    kernel_memset(shm, 0, sizeof(shm_t));
+    shm->size = up2(size, MEM_PAGE_SIZE);
+    shm->page_count = shm->size / MEM_PAGE_SIZE;
+
+    shm->pages = (uint32_t *)kmalloc(shm->page_count * sizeof(uint32_t));
+    if (shm->pages == (uint32_t *)0) {
+        kmem_cache_free(&shm_cache, shm);
+        return (shm_t *)0;
+    }
+    kernel_memset(shm->pages, 0, shm->page_count * sizeof(uint32_t));
+    return shm;
+}
+
+/**
+ * 扩大记录物理页的数组，使段至少有size字节，新增的页在首次访问时分配
+ */
+static int shm_grow(shm_t * shm, int size) {
+    int page_count = up2(size, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    if (page_count <= shm->page_count) {
+        return 0;
+    }
+
+    uint32_t * pages = (uint32_t *)kmalloc(page_count * sizeof(uint32_t));
+    if (pages == (uint32_t *)0) {
+        return -1;
+    }
+    kernel_memset(pages, 0, page_count * sizeof(uint32_t));
+    kernel_memcpy(shm->pages, pages, shm->page_count * sizeof(uint32_t));
+    kfree(shm->pages);
+
+    shm->pages = pages;
+    shm->page_count = page_count;
+    shm->size = page_count * MEM_PAGE_SIZE;
+    return 0;
+}
+
+static shm_t * shm_create(const char * name, int size) {
+    shm_t * shm = shm_alloc(size);
+    if (shm == (shm_t *)0) {
+        log_printf("shm: alloc memory failed.");
+        return (shm_t *)0;
+    }
+    kernel_strncpy((char *)name, shm->name, SHM_NAME_SIZE);
+
+    for (int i = 0; i < shm->page_count; i++) {
+        shm->pages[i] = memory_alloc_zeroed_page();
+        if (shm->pages[i] == 0) {
+            goto shm_create_failed;
+        }
+    }
+
+    shm->id = shm_next_id++;
+    list_insert_last(&shm_list, &shm->node);
+    return shm;
+shm_create_failed:
+    log_printf("shm: alloc memory failed.");
+    shm_free(shm);
+    return (shm_t *)0;
+}
+
+void shm_get(shm_t * shm) {
+    mutex_lock(&shm_mutex);
+    shm->ref++;
+    mutex_unlock(&shm_mutex);
+}
+
+void shm_put(shm_t * shm) {
+    mutex_lock(&shm_mutex);
+    if ((--shm->ref == 0) && shm->removed) {
+        if (shm->file) {
+            list_remove(&shm_file_list, &shm->node);
+        }
+        shm_free(shm);
+    }
+    mutex_unlock(&shm_mutex);
+}
+
+/**
+ * 取段中的一页，尚未分配时分配并清零，文件的页缓存再从文件中读入该页的内容
+ */
+uint32_t shm_page(shm_t * shm, int index) {
+    ASSERT(index < shm->page_count);
+
+    mutex_lock(&shm_mutex);
+    uint32_t page = shm->pages[index];
+    if (page) {
+        mutex_unlock(&shm_mutex);
+        return page;
+    }
+
+    page = memory_alloc_zeroed_page();
+    if (page == 0) {
+        goto shm_page_failed;
+    }
+
+    uint32_t offset = index * MEM_PAGE_SIZE;
+    if (shm->file && (offset < shm->file->size)) {
+        int size = shm->file->size - offset;
+        if (size > MEM_PAGE_SIZE) {
+            size = MEM_PAGE_SIZE;
+        }
+        if (fs_read_file(shm->file, offset, (char *)page, size) < size) {
+            memory_release_page(page);
+            goto shm_page_failed;
+        }
+    }
+
+    shm->pages[index] = page;
+    mutex_unlock(&shm_mutex);
+    return page;
+shm_page_failed:
+    log_printf("shm: load page %d failed.", index);
+    mutex_unlock(&shm_mutex);
+    return 0;
+}
+
+/**
+ * 为匿名的共享映射创建一个段，fork出的进程通过它共享尚未访问过的页
+ * 段不在名称表中，最后一次解除映射后释放
+ */
+shm_t * shm_create_anon(int size) {
+    shm_t * shm = shm_alloc(size);
+    if (shm == (shm_t *)0) {
+        log_printf("shm: alloc memory failed.");
+        return (shm_t *)0;
+    }
+    shm->ref = 1;
+    shm->removed = 1;
+    return shm;
+}
+
+/**
+ * 取文件的页缓存，同一文件的所有共享映射都使用它，size为映射到的文件末端
+ */
+shm_t * shm_get_file(file_t * file, uint32_t size) {
+    mutex_lock(&shm_mutex);
+    shm_t * shm = shm_find_file(file);
+    if (shm) {
+        if (shm_grow(shm, size) < 0) {
+            goto get_file_failed;
+        }
+        shm->ref++;
+        mutex_unlock(&shm_mutex);
+        return shm;
+    }
+
+    shm = shm_alloc(size);
+    if (shm == (shm_t *)0) {
+        goto get_file_failed;
+    }
+    file_inc_ref(file);
+    shm->file = file;
+    shm->ref = 1;
+    shm->removed = 1;
+    list_insert_last(&shm_file_list, &shm->node);
+    mutex_unlock(&shm_mutex);
+    return shm;
+get_file_failed:
+    log_printf("shm: alloc page cache failed.");
+    mutex_unlock(&shm_mutex);
+    return (shm_t *)0;
+}
+
+/**
+ * 按名称获取共享内存段，不存在时按size创建，返回段的id
+ */
+int sys_shmget(const char * name, int size) {
+    if ((name == (const char *)0) || (name[0] == '\0') || (kernel_strlen(name) >= SHM_NAME_SIZE)) {
+        return -1;
+    }
+
+    mutex_lock(&shm_mutex);
+    shm_t * shm = shm_find_name(name);
+    if (shm == (shm_t *)0) {
+        if ((size <= 0) || (size > SHM_SIZE_MAX)) {
+            log_printf("shm: bad size %d", size);
+            mutex_unlock(&shm_mutex);
+            return -1;
+        }
+        shm = shm_create(name, size);
+    }
+    int id = shm ? shm->id : -1;
+    mutex_unlock(&shm_mutex);
+    return id;
+}
+
+/**
+ * 将共享内存段映射到进程中，页在首次访问时映射到段的物理页上
+ */
+void * sys_shmat(int id, void * addr) {
+    task_t * task = task_current();
+
+    mutex_lock(&shm_mutex);
+    shm_t * shm = shm_find_id(id);
+    if (shm == (shm_t *)0) {
+        mutex_unlock(&shm_mutex);
+        return (void *)-1;
+    }
+    shm->ref++;
+    mutex_unlock(&shm_mutex);
+
+    uint32_t mmap_end = MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE;
+    uint32_t start = (uint32_t)addr;
+    if ((start < MEM_TASK_MMAP_BASE) || (start & (MEM_PAGE_SIZE - 1)) ||
+            (vma_find_free(&task->mm->vma_list, start, mmap_end, shm->size) != start)) {
+        start = vma_find_free(&task->mm->vma_list, MEM_TASK_MMAP_BASE, mmap_end, shm->size);
+        if (start == 0) {
+            log_printf("shm: no free space");
+            goto shmat_failed;
+        }
+    }
+
+    vma_t * vma = vma_create(&task->mm->vma_list, start, start + shm->size,
+            PTE_P | PTE_W | PTE_U | PTE_SHARED, VMA_MMAP | VMA_SHARED | VMA_SHM);
+    if (vma == (vma_t *)0) {
+        goto shmat_failed;
+    }
+    vma->shm = shm;
+    return (void *)start;
+shmat_failed:
+    shm_put(shm);
+    return (void *)-1;
+}
+
+int sys_shmdt(void * addr) {
+    task_t * task = task_current();
+    vma_t * vma = vma_find(&task->mm->vma_list, (uint32_t)addr);
+    if ((vma == (vma_t *)0) || !(vma->flags & VMA_SHM) || (vma->start != (uint32_t)addr)) {
+        return -1;
+    }
+    return sys_munmap(addr, vma->end - vma->start);
+}
+
+/**
+ * 删除共享内存段，已有的映射仍然有效，全部解除后释放物理页
+ */
+int sys_shmrm(int id) {
+    mutex_lock(&shm_mutex);
+    shm_t * shm = shm_find_id(id);
+    if (shm == (shm_t *)0) {
+        mutex_unlock(&shm_mutex);
+        return -1;
+    }
+    list_remove(&shm_list, &shm->node);
+    shm->removed = 1;
+    if (shm->ref == 0) {
+        shm_free(shm);
+    }
+    mutex_unlock(&shm_mutex);
+    return 0;
+}
@@ -3,28 +3,45 @@
 
 
 int bitmap_byte_count(int bit_count) {
-    return (bit_count + (8 - 1)) / 8;
+    // 按字对齐，以便整字访问
+    int word_count = (bit_count + (BITMAP_WORD_BITS - 1)) / BITMAP_WORD_BITS;
+    return word_count * sizeof(uint32_t);
 }
 
 void bitmap_init(bitmap_t * bitmap, uint8_t * bits, int bit_count, int init_bit) {
     bitmap->bit_count = bit_count;
-    bitmap->bits = bits;
+    bitmap->next = 0;
+    bitmap->bits = (uint32_t *)bits;
     
     int byte_count = bitmap_byte_count(bitmap->bit_count);
     kernel_memset(bitmap->bits, init_bit ? 0xFF : 0, byte_count);
 }
 
 int bitmap_get_bit(bitmap_t * bitmap, int index) {
-    return bitmap->bits[index / 8] & (1 << (index % 8));
+    return bitmap->bits[index / BITMAP_WORD_BITS] & (1u << (index % BITMAP_WORD_BITS));
 }
 
 void bitmap_set_bit(bitmap_t * bitmap, int index, int count, int bit) {
-    for (int i = 0; (i < count) && (index < bitmap->bit_count); i++, index++) {
+    int end = index + count;
+    if (end > bitmap->bit_count) {
+        end = bitmap->bit_count;
+    }
+
+    // 每次处理一个字中的连续位
+    while (index < end) {
+        int offset = index % BITMAP_WORD_BITS;
+        int n = BITMAP_WORD_BITS - offset;
+        if (n > end - index) {
+            n = end - index;
+        }
+
+        uint32_t mask = (n == BITMAP_WORD_BITS) ? 0xFFFFFFFF : (((1u << n) - 1) << offset);
         if (bit) {
-            bitmap->bits[index / 8] |= (1 << (index % 8));
+            bitmap->bits[index / BITMAP_WORD_BITS] |= mask;
         } else {
-            bitmap->bits[index / 8] &= ~(1 << (index % 8));
+            bitmap->bits[index / BITMAP_WORD_BITS] &= ~mask;
         }
+        index += n;
     }
 }
 
@@ -32,30 +49,68 @@ int bitmap_is_set(bitmap_t * bitmap, int index) {
     return bitmap_get_bit(bitmap, index) ? 1 : 0;
 }
 
+/**
+ * 在[start, end)中查找第一个值为bit的位置，找不到返回end
+ */
+static int bitmap_find(bitmap_t * bitmap, int bit, int start, int end) {
+    while (start < end) {
+        uint32_t word = bitmap->bits[start / BITMAP_WORD_BITS];
+        if (!bit) {
+            word = ~word;
+        }
+        word &= 0xFFFFFFFF << (start % BITMAP_WORD_BITS);
+
+        // 整字都不满足时直接跳过
+        if (word) {
+            int index = (start & ~(BITMAP_WORD_BITS - 1)) + __builtin_ctz(word);
+            return index < end ? index : end;
+        }
+        start = (start & ~(BITMAP_WORD_BITS - 1)) + BITMAP_WORD_BITS;
+    }
+    return end;
+}
 
-int bitmap_alloc_nbits(bitmap_t * bitmap, int bit, int count) {
-    int search_idx = 0;
-    int ok_index = -1;
-
-    while (search_idx < bitmap->bit_count) {
-        if (bitmap_is_set(bitmap, search_idx) != bit) {
-            search_idx++;
-            continue;
-        }
-        ok_index = search_idx;
-        int i = 1;
-        for ( ; (i < count) && (search_idx < bitmap->bit_count); i++) {
-            if (bitmap_is_set(bitmap, search_idx++) != bit) {
-                ok_index = -1;
-                break;
-            }
-        }
-        if (i >= count) {
-            bitmap_set_bit(bitmap, ok_index, count, ~bit);
-            return ok_index;
+/**
+ * 在[start, end)中查找count个连续的值为bit的位
+ */
+static int bitmap_search(bitmap_t * bitmap, int bit, int count, int start, int end) {
+    while (start + count <= end) {
+        start = bitmap_find(bitmap, bit, start, end);
+        if (start + count > end) {
+            break;
         }
+
+        int stop = bitmap_find(bitmap, !bit, start, start + count);
+        if (stop >= start + count) {
+            return start;
+        }
+        start = stop;
     }
     return -1;
 }
 
+int bitmap_alloc_nbits(bitmap_t * bitmap, int bit, int count) {
+    if (count <= 0) {
+        return -1;
+    }
+
+    // 从上次分配的位置往后找，找不到再从头找
+    int ok_index = bitmap_search(bitmap, bit, count, bitmap->next, bitmap->bit_count);
+    if (ok_index < 0) {
+        int end = bitmap->next + count - 1;
+        if (end > bitmap->bit_count) {
+            end = bitmap->bit_count;
+        }
+        ok_index = bitmap_search(bitmap, bit, count, 0, end);
+        if (ok_index < 0) {
+            return -1;
+        }
+    }
 
+    bitmap_set_bit(bitmap, ok_index, count, !bit);
+    bitmap->next = ok_index + count;
+    if (bitmap->next >= bitmap->bit_count) {
+        bitmap->next = 0;
+    }
+    return ok_index;
+}
@@ -176,6 +176,7 @@ void pannic(const char * file, int line, const char * func, const char * cond) {
     log_printf("file: %s", file);
     log_printf("line: %d", line);
     log_printf("func: %s", func);
+    log_flush();
 
     for (; ; ) {
         hlt();
@@ -34,6 +34,24 @@ void list_insert_last(list_t * list, list_node_t * node) {
 }
 
 
+// 插入到next之前，next为空时插入到末尾
+void list_insert_before(list_t * list, list_node_t * next, list_node_t * node) {
+    if (next == (list_node_t *)0) {
+        list_insert_last(list, node);
+        return;
+    }
+    if (next == list->first) {
+        list_insert_first(list, node);
+        return;
+    }
+
+    node->pre = next->pre;
+    node->next = next;
+    next->pre->next = node;
+    next->pre = node;
+    list->count++;
+}
+
 list_node_t * list_remove_first(list_t * list) {
 
     if (list_is_empty(list)) {
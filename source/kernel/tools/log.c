@@ -3,6 +3,7 @@
 #include "dev/console.h"
 #include "dev/dev.h"
 #include "ipc/mutex.h"
+#include "core/workqueue.h"
 #include "tools/log.h"
 #include "comm/cpu_instr.h"
 #include "tools/klib.h"
@@ -12,13 +13,26 @@
 
 #define     COM1_PORT       0x3F8
 
+#define     LOG_BUF_SIZE    4096            // 待输出日志的缓冲区大小
+
 
 static int log_dev_id;
 
 static mutex_t mutex;
 
+// 日志先放入缓冲区，由kworker写到终端，中断和系统调用中不等待输出
+static char log_buf[LOG_BUF_SIZE];
+static uint32_t log_read, log_write;        // 读写位置，只增不减，取模得到下标
+static int log_lost;                        // 缓冲区满时丢弃的条数
+static work_t log_work;
+
+static void log_work_fn(work_t * work) {
+    log_flush();
+}
+
 void log_init(void) {
     mutex_init(&mutex);
+    work_init(&log_work, log_work_fn);
 
     log_dev_id = dev_open(DEV_TTY, 0, (void *)0);
 
@@ -33,6 +47,59 @@ void log_init(void) {
 #endif
 }
 
+static void log_output(const char * buf, int size) {
+#if LOG_USE_COM
+    for (int i = 0; i < size; i++) {
+        if (buf[i] == '\n') {
+            while ((inb(COM1_PORT + 5) & (1 << 6)) == 0);
+            outb(COM1_PORT, '\r');
+        }
+        while ((inb(COM1_PORT + 5) & (1 << 6)) == 0);
+        outb(COM1_PORT, buf[i]);
+    }
+#else
+    dev_write(log_dev_id, 0, (char *)buf, size);
+#endif
+}
+
+static void log_put(const char * str, int size) {
+    while (size--) {
+        log_buf[log_write++ % LOG_BUF_SIZE] = *str++;
+    }
+}
+
+/**
+ * 把缓冲区中的日志全部输出，由kworker调用；工作队列创建前及死机时直接调用
+ */
+void log_flush(void) {
+    char buf[128];
+
+    mutex_lock(&mutex);
+    for (;;) {
+        irq_state_t state = irq_enter_protection();
+        int size = 0;
+        while ((log_read != log_write) && (size < sizeof(buf))) {
+            buf[size++] = log_buf[log_read++ % LOG_BUF_SIZE];
+        }
+        int lost = log_lost;
+        if (size == 0) {
+            log_lost = 0;
+        }
+        irq_leave_protection(state);
+
+        if (size) {
+            log_output(buf, size);
+        } else {
+            if (lost) {
+                kernel_sprintf(buf, "log:%d lines lost\n", lost);
+                log_output(buf, kernel_strlen(buf));
+            }
+            break;
+        }
+    }
+    mutex_unlock(&mutex);
+}
+
 void log_printf(const char * fmt, ...) {
 
     char str_buff[128];
@@ -43,26 +110,21 @@ void log_printf(const char * fmt, ...) {
     kernel_vsprintf(str_buff, fmt, args);
     va_end(args);
 
-    mutex_lock(&mutex);
-
-#if LOG_USE_COM
-    const char * p = str_buff;
-    while (*p != '\0') {
-        while ((inb(COM1_PORT + 5) & (1 << 6)) == 0);
-        outb(COM1_PORT, *p++);
+    // 整行放入缓冲区，放不下时丢弃，不输出半行
+    int len = kernel_strlen(str_buff);
+    irq_state_t state = irq_enter_protection();
+    if (LOG_BUF_SIZE - (log_write - log_read) >= len + 5) {
+        log_put("log:", 4);
+        log_put(str_buff, len);
+        log_put("\n", 1);
+    } else {
+        log_lost++;
     }
-    outb(COM1_PORT, '\r');
-    outb(COM1_PORT, '\n');
+    irq_leave_protection(state);
 
-#else
-    // console_write(0, str_buff, kernel_strlen(str_buff));
-    dev_write(log_dev_id, 0, "log:", 4);
-    dev_write(log_dev_id, 0, str_buff, kernel_strlen(str_buff));
-    char c = '\n';
-    dev_write(log_dev_id, 0, &c, 1);
-    // console_write(0, &c, 1);
-#endif
-
-    mutex_unlock(&mutex);
+    // 工作队列创建之前直接输出
+    if (work_schedule(&log_work) < 0) {
+        log_flush();
+    }
 }
 
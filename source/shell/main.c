@@ -171,25 +171,42 @@ static int do_cp(int argc, char ** argv) {
         fprintf(stderr, "no [src] or [to]");
         return -1;
     }
-    FILE * from, * to;
-    from = fopen(argv[1], "rb");
-    to = fopen(argv[2], "wb");
-    if (!from || !to) {
+    int from = open(argv[1], O_RDONLY);
+    int to = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC);
+    if ((from < 0) || (to < 0)) {
         fprintf(stderr, "open file failed..");
-        goto ls_failed;
+        goto cp_failed;
     }
-    char * buf = (char *)malloc(255);
-    int size = 0;
-    while ((size = fread(buf, 1, 255, from)) > 0) {
-        fwrite(buf, 1, size, to);
+
+    // 按窗口映射源文件，写入时不再经过中间缓冲区，占用的内存不随文件大小增长
+    struct stat st;
+    if ((fstat(from, &st) < 0) || (st.st_size <= 0)) {
+        goto cp_failed;
     }
-    free(buf);
-ls_failed:
-    if (from) {
-        fclose(from);
+    for (int offset = 0; offset < st.st_size; offset += CP_WINDOW_SIZE) {
+        int size = st.st_size - offset;
+        if (size > CP_WINDOW_SIZE) {
+            size = CP_WINDOW_SIZE;
+        }
+
+        char * data = (char *)mmap((void *)0, size, PROT_READ, MAP_PRIVATE, from, offset);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "map file failed..");
+            goto cp_failed;
+        }
+        int cnt = write(to, data, size);
+        munmap(data, size);
+        if (cnt < size) {
+            fprintf(stderr, "write file failed..");
+            goto cp_failed;
+        }
     }
-    if (to) {
-        fclose(to);
+cp_failed:
+    if (from >= 0) {
+        close(from);
+    }
+    if (to >= 0) {
+        close(to);
     }
     return 0;
 }
@@ -274,18 +291,13 @@ static void run_buildin(const cli_cmd_t * cmd, int argc, char ** argv) {
 }
 
 static void run_exec_file(const char * path, int argc, char ** argv) {
-    int pid = fork();
+    // 直接由程序文件创建进程，不用先复制shell的地址空间
+    int pid = spawn(path, argv, (const int *)0);
     if (pid < 0) {
-        fprintf(stderr, "fork failed %s", path);
-    } else if (pid == 0) {
-        int err = execve(path, argv, (char *const *)0);
-        if (err < 0) {
-            fprintf(stderr, "exec failed: %s", path);
-        }
-        exit(-1);
+        fprintf(stderr, "exec failed: %s", path);
     } else {
         int status;
-        int pid = wait(&status);
+        pid = waitpid(pid, &status, 0);
         fprintf(stderr, "cmd %s result: %d, pid=%d\n", path, status, pid);
     }
 }
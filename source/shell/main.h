@@ -3,6 +3,7 @@
 
 #define CLI_INPUT_SIZE                  1024
 #define CLI_MAX_ARG_COUNT               10
+#define CP_WINDOW_SIZE                  (64 * 1024)     // cp每次映射源文件的大小
 
 #define ESC_CMD2(Pn, cmd)               "\x1b["#Pn#cmd
 #define ESC_CLEAR_SCREEN                ESC_CMD2(2, J)